@@ -0,0 +1,347 @@
+/**
+ * @file assetloader.cpp
+ * Background asset loading.
+ *
+ * Implements the worker and upload threads, the GLX upload context and
+ * the budgeted upload used without it.
+ */
+
+#include <chrono>
+#include <algorithm>
+#include "assetloader.h"
+#include "utils.h"
+#include "trace.h"
+#include "frameaudit.h"
+
+#if defined(__linux__) && !defined(ASSETLOADER_NO_GLX)
+#define ASSETLOADER_GLX 1
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#endif
+
+
+AssetLoader::AssetLoader()
+    : stopping(false), shared(false), display(NULL), context(NULL), pbuffer(0), bytesUploaded(0), updateMs(0.0)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    decodeWake.notify_all();
+    uploadWake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    if (uploader.joinable())
+        uploader.join();
+}
+
+void AssetLoader::initThreads()
+{
+#ifdef ASSETLOADER_GLX
+    // The upload thread makes GLX calls on the display GLUT opened.
+    XInitThreads();
+#endif
+}
+
+#ifdef ASSETLOADER_GLX
+/** Swallows the X errors of a failed context creation (the default handler exits). */
+static int ignoreXError(Display *, XErrorEvent *)
+{
+    return 0;
+}
+#endif
+
+bool AssetLoader::createContext()
+{
+#ifdef ASSETLOADER_GLX
+    Display *dpy = glXGetCurrentDisplay();
+    GLXContext share = glXGetCurrentContext();
+    if (!dpy || !share)
+        return false;
+
+    typedef GLXContext (*CreateContextAttribs)(Display *, GLXFBConfig, GLXContext, Bool, const int *);
+    CreateContextAttribs createContextAttribs =
+        (CreateContextAttribs)glXGetProcAddress((const GLubyte *)"glXCreateContextAttribsARB");
+    if (!createContextAttribs)
+        return false;
+
+    // Same framebuffer configuration as the window's context.
+    int configId = 0, screen = 0, count = 0;
+    glXQueryContext(dpy, share, GLX_FBCONFIG_ID, &configId);
+    glXQueryContext(dpy, share, GLX_SCREEN, &screen);
+    int configAttribs[] = { GLX_FBCONFIG_ID, configId, None };
+    GLXFBConfig *configs = glXChooseFBConfig(dpy, screen, configAttribs, &count);
+    if (!configs || count == 0)
+        return false;
+
+    int contextAttribs[] = {
+        GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+        GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+        GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+        None
+    };
+    int pbufferAttribs[] = { GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None };
+
+    XSync(dpy, False);
+    int (*handler)(Display *, XErrorEvent *) = XSetErrorHandler(ignoreXError);
+    GLXContext ctx = createContextAttribs(dpy, configs[0], share, True, contextAttribs);
+    // The context never draws; a 1x1 pbuffer only gives it something to be current on.
+    GLXPbuffer pb = ctx ? glXCreatePbuffer(dpy, configs[0], pbufferAttribs) : 0;
+    XSync(dpy, False);
+    XSetErrorHandler(handler);
+    XFree(configs);
+
+    if (!ctx)
+        return false;
+
+    display = dpy;
+    context = ctx;
+    pbuffer = pb;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AssetLoader::start(int workerCount, bool shareContext)
+{
+    if (!workers.empty())
+        return;
+
+    if (workerCount < 0)
+    {
+        int hardware = std::thread::hardware_concurrency();
+        workerCount = hardware > 1 ? hardware - 1 : 1;
+    }
+    for (int i = 0; i < std::max(workerCount, 1); i++)
+        workers.push_back(std::thread(&AssetLoader::decodeLoop, this));
+
+    if (shareContext && createContext())
+    {
+        shared = true;
+        uploader = std::thread(&AssetLoader::uploadLoop, this);
+    }
+}
+
+bool AssetLoader::sharedContext() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return shared;
+}
+
+int AssetLoader::load(AssetDecodeFunc decode)
+{
+    std::unique_ptr<Entry> e(new Entry());
+    e->decode = decode;
+    e->state = ASSET_QUEUED;
+    e->fence = 0;
+    e->buffer = e->offset = 0;
+
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = entries.size();
+        entries.push_back(std::move(e));
+        decodeQueue.push_back(id);
+    }
+    decodeWake.notify_one();
+    return id;
+}
+
+AssetState AssetLoader::state(int id) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries[id]->state;
+}
+
+void AssetLoader::decodeLoop()
+{
+    TRACE_THREAD_NAME("asset worker");
+    frameAuditExemptThread();
+    for (;;)
+    {
+        Entry *e;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            decodeWake.wait(lock, [this] { return stopping || !decodeQueue.empty(); });
+            if (stopping)
+                return;
+            e = entries[decodeQueue.front()].get();
+            uploadQueue.push_back(decodeQueue.front());
+            decodeQueue.pop_front();
+            e->state = ASSET_DECODING;
+        }
+
+        {
+            TRACE_SCOPE("asset decode");
+            e->decode(e->asset);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            e->state = ASSET_UPLOADING;
+        }
+        uploadWake.notify_one();
+    }
+}
+
+void AssetLoader::createBuffers(Entry &e)
+{
+    e.asset.buffers.resize(e.asset.data.size());
+    if (!e.asset.buffers.empty())
+        glGenBuffers(e.asset.buffers.size(), e.asset.buffers.data());
+}
+
+void AssetLoader::uploadLoop()
+{
+#ifdef ASSETLOADER_GLX
+    TRACE_THREAD_NAME("asset upload");
+    frameAuditExemptThread();
+    Display *dpy = (Display *)display;
+    if (!glXMakeContextCurrent(dpy, pbuffer, pbuffer, (GLXContext)context))
+    {
+        // Left to update() on the render thread.
+        std::lock_guard<std::mutex> lock(mutex);
+        shared = false;
+        return;
+    }
+
+    for (;;)
+    {
+        Entry *e = NULL;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            uploadWake.wait(lock, [this] {
+                return stopping || (!uploadQueue.empty() && entries[uploadQueue.front()]->state == ASSET_UPLOADING);
+            });
+            if (stopping)
+                break;
+            e = entries[uploadQueue.front()].get();
+            uploadQueue.pop_front();
+        }
+
+        TRACE_SCOPE("asset upload");
+        // This context has no VAO bound, so the buffers can be filled through any target.
+        createBuffers(*e);
+        size_t bytes = 0;
+        for (size_t i = 0; i < e->asset.data.size(); i++)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, e->asset.buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, e->asset.data[i].size(), e->asset.data[i].data(), GL_STATIC_DRAW);
+            bytes += e->asset.data[i].size();
+            std::vector<unsigned char>().swap(e->asset.data[i]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // The flush makes sure the fence reaches the GPU and is eventually signaled.
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        e->fence = fence;
+        bytesUploaded += bytes;
+    }
+
+    glXMakeContextCurrent(dpy, None, None, NULL);
+    if (pbuffer)
+        glXDestroyPbuffer(dpy, pbuffer);
+    glXDestroyContext(dpy, (GLXContext)context);
+#endif
+}
+
+void AssetLoader::update()
+{
+    TRACE_SCOPE("asset update");
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!shared)
+    {
+        // Oldest decoded asset first, a chunk at a time, until the budget is spent.
+        size_t budget = ASSETLOADER_UPLOAD_BUDGET;
+        while (budget > 0 && !uploadQueue.empty() && entries[uploadQueue.front()]->state == ASSET_UPLOADING)
+        {
+            Entry &e = *entries[uploadQueue.front()];
+            lock.unlock();
+
+            if (e.asset.buffers.empty() && !e.asset.data.empty())
+            {
+                createBuffers(e);
+                for (size_t i = 0; i < e.asset.data.size(); i++)
+                {
+                    cacheBindBuffer(GL_COPY_WRITE_BUFFER, e.asset.buffers[i]);
+                    glBufferData(GL_COPY_WRITE_BUFFER, e.asset.data[i].size(), NULL, GL_STATIC_DRAW);
+                }
+            }
+
+            while (budget > 0 && e.buffer < e.asset.data.size())
+            {
+                std::vector<unsigned char> &data = e.asset.data[e.buffer];
+                size_t bytes = std::min(budget, data.size() - e.offset);
+                cacheBindBuffer(GL_COPY_WRITE_BUFFER, e.asset.buffers[e.buffer]);
+                glBufferSubData(GL_COPY_WRITE_BUFFER, e.offset, bytes, data.data() + e.offset);
+                e.offset += bytes;
+                budget -= bytes;
+                bytesUploaded += bytes;
+                if (e.offset == data.size())
+                {
+                    std::vector<unsigned char>().swap(data);
+                    e.buffer++;
+                    e.offset = 0;
+                }
+            }
+
+            lock.lock();
+            if (e.buffer == e.asset.data.size())
+            {
+                e.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                uploadQueue.pop_front();
+            }
+        }
+    }
+
+    lock.unlock();
+
+    updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+const Asset *AssetLoader::ready(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry &e = *entries[id];
+    if (e.state == ASSET_READY)
+        return &e.asset;
+    if (!e.fence)
+        return NULL;
+
+    // Zero timeout: only asks whether the fence passed.
+    GLenum status = glClientWaitSync(e.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return NULL;
+
+    glDeleteSync(e.fence);
+    e.fence = 0;
+    e.state = ASSET_READY;
+    return &e.asset;
+}
+
+AssetLoaderStats AssetLoader::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    AssetLoaderStats s = {};
+    for (size_t i = 0; i < entries.size(); i++)
+        switch (entries[i]->state)
+        {
+            case ASSET_QUEUED:    s.queued++; break;
+            case ASSET_DECODING:  s.decoding++; break;
+            case ASSET_UPLOADING: s.uploading++; break;
+            case ASSET_READY:     s.ready++; break;
+        }
+    s.bytesUploaded = bytesUploaded;
+    s.updateMs = updateMs;
+    return s;
+}
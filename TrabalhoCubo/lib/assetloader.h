@@ -0,0 +1,176 @@
+/**
+ * @file assetloader.h
+ * Background asset loading.
+ *
+ * Keeps loading off the GLUT thread. Worker threads run the decode
+ * function of each asset (reading, generating or converting data into
+ * plain byte arrays), and the bytes become GL buffers in one of two ways:
+ *
+ * - With a shared context (GLX on Linux), an upload thread owns a second
+ *   context in the same share group, creates and fills the buffers there
+ *   and puts a fence after them. Buffers and fences are shared; the
+ *   render thread only polls the fence.
+ * - Otherwise update(), called once per frame on the render thread,
+ *   uploads at most ASSETLOADER_UPLOAD_BUDGET bytes per frame, so a large
+ *   asset is spread over several frames instead of causing a spike.
+ *
+ * The render thread never waits: ready() returns NULL until the asset is
+ * on the GPU, and the program draws a placeholder meanwhile. VAOs are not
+ * shared between contexts, so they are created on the render thread once
+ * the asset is ready.
+ */
+
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+
+/** Bytes uploaded per update() without a shared context. */
+#define ASSETLOADER_UPLOAD_BUDGET (1 << 20)
+
+/** Loading stage of an asset. */
+enum AssetState
+{
+    /** Waiting for a worker. */
+    ASSET_QUEUED,
+    /** Decode function running. */
+    ASSET_DECODING,
+    /** Buffers being created and filled. */
+    ASSET_UPLOADING,
+    /** Buffers on the GPU (fence passed). */
+    ASSET_READY
+};
+
+/** Data of an asset. */
+struct Asset
+{
+    /** Contents of each buffer, filled by the decode function; released once uploaded. */
+    std::vector<std::vector<unsigned char> > data;
+    /** GL buffers (one per data entry), valid once the asset is ready. */
+    std::vector<GLuint> buffers;
+};
+
+/**
+ * Decode function.
+ *
+ * Runs on a worker thread without a GL context: must only fill the asset's
+ * data (and state owned by the caller that is read after ready()).
+ */
+typedef std::function<void (Asset &)> AssetDecodeFunc;
+
+/** Loader counters. */
+struct AssetLoaderStats
+{
+    /** Assets in each state. */
+    unsigned int queued, decoding, uploading, ready;
+    /** Bytes uploaded since the start. */
+    size_t bytesUploaded;
+    /** Render thread time spent in the last update(), in milliseconds. */
+    double updateMs;
+};
+
+/**
+ * Worker threads, upload context and per-frame pickup of loaded assets.
+ */
+class AssetLoader
+{
+public:
+    AssetLoader();
+    ~AssetLoader();
+
+    /**
+     * Make the window system library safe for the upload thread.
+     *
+     * Must be called first in main(), before glutInit().
+     */
+    static void initThreads();
+
+    /**
+     * Start the threads.
+     *
+     * Called on the render thread with its context current, which becomes
+     * the share context of the upload context.
+     *
+     * @param workers Decode threads; -1 uses the hardware threads minus one.
+     * @param shareContext Try to create the shared upload context.
+     */
+    void start(int workers = -1, bool shareContext = true);
+
+    /**
+     * Queue an asset.
+     *
+     * @param decode Decode function.
+     * @return Asset identifier.
+     */
+    int load(AssetDecodeFunc decode);
+
+    /** Loading stage of an asset. */
+    AssetState state(int id) const;
+
+    /**
+     * Asset if loaded.
+     *
+     * Never blocks (the fence is polled with a zero timeout).
+     *
+     * @param id Asset identifier.
+     * @return Asset, or NULL while it is still loading.
+     */
+    const Asset *ready(int id);
+
+    /**
+     * Per-frame work on the render thread.
+     *
+     * Uploads within the budget when there is no shared context.
+     */
+    void update();
+
+    /** Buffers are filled by the upload thread's shared context. */
+    bool sharedContext() const;
+
+    /** Counters. */
+    AssetLoaderStats stats() const;
+
+private:
+    struct Entry
+    {
+        AssetDecodeFunc decode;
+        Asset asset;
+        AssetState state;
+        GLsync fence;
+        /** Progress of the budgeted upload: current buffer and bytes of it. */
+        size_t buffer, offset;
+    };
+
+    void decodeLoop();
+    void uploadLoop();
+    bool createContext();
+    void createBuffers(Entry &e);
+
+    std::vector<std::unique_ptr<Entry> > entries;
+    std::deque<int> decodeQueue, uploadQueue;
+    std::vector<std::thread> workers;
+    std::thread uploader;
+    mutable std::mutex mutex;
+    std::condition_variable decodeWake, uploadWake;
+    bool stopping;
+    /** The upload thread's context is current (otherwise update() uploads). */
+    bool shared;
+
+    /** GLX display, context and pbuffer (opaque, so this header needs no X11). */
+    void *display, *context;
+    unsigned long pbuffer;
+
+    size_t bytesUploaded;
+    double updateMs;
+};
+
+#endif
@@ -0,0 +1,446 @@
+/**
+ * @file capture.cpp
+ * Frame capture.
+ *
+ * Implements the pixel buffer ring and the writer thread.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "capture.h"
+#include "utils.h"
+#include "trace.h"
+#include "frameaudit.h"
+
+
+/** Frames allowed to wait for the writer before new ones are dropped. */
+#define CAPTURE_MAX_QUEUED 8
+
+
+FrameCapture::FrameCapture()
+    : running(false), format(CAPTURE_PPM), fps(60),
+      pboWidth(0), pboHeight(0), next(0), frames(0),
+      stream(NULL), streamWidth(0), streamHeight(0), quit(false)
+{
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        pbo[i] = 0;
+        inFlight[i] = false;
+        slotNumber[i] = 0;
+    }
+}
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+}
+
+CaptureFormat FrameCapture::formatFromPath(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    if (ext && strcmp(ext, ".png") == 0)
+        return CAPTURE_PNG;
+    if (ext && strcmp(ext, ".y4m") == 0)
+        return CAPTURE_Y4M;
+    return CAPTURE_PPM;
+}
+
+bool FrameCapture::start(const char *path, CaptureFormat format, int fps)
+{
+    if (running)
+        stop();
+
+    this->path = path;
+    this->format = format;
+    this->fps = fps;
+
+    if (format == CAPTURE_Y4M)
+    {
+        stream = fopen(path, "wb");
+        if (!stream)
+        {
+            std::cout << "ERROR: Could not open capture file " << path << std::endl;
+            return false;
+        }
+        streamWidth = streamHeight = 0;
+    }
+
+    frames = 0;
+    next = 0;
+    quit = false;
+    running = true;
+    thread = std::thread(&FrameCapture::writer, this);
+
+    return true;
+}
+
+void FrameCapture::stop()
+{
+    if (!running)
+        return;
+
+    // Oldest slot first, so frames reach the writer in order.
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+        collect((next + i) % CAPTURE_RING_SIZE);
+    release();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    ready.notify_one();
+    thread.join();
+
+    if (stream)
+    {
+        fclose(stream);
+        stream = NULL;
+    }
+    running = false;
+    pool.clear();
+
+    std::cout << "Captured " << frames << " frames to " << path << std::endl;
+}
+
+void FrameCapture::allocate(int width, int height)
+{
+    glGenBuffers(CAPTURE_RING_SIZE, pbo);
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        cacheBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+        inFlight[i] = false;
+    }
+    cacheBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pboWidth = width;
+    pboHeight = height;
+    next = 0;
+}
+
+void FrameCapture::release()
+{
+    if (!pbo[0])
+        return;
+    glDeleteBuffers(CAPTURE_RING_SIZE, pbo);
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        pbo[i] = 0;
+        inFlight[i] = false;
+    }
+    pboWidth = pboHeight = 0;
+}
+
+/**
+ * Collect readback.
+ *
+ * Maps a slot whose transfer was started frames ago and queues a copy of
+ * its pixels for the writer.
+ */
+void FrameCapture::collect(int slot)
+{
+    if (!inFlight[slot])
+        return;
+    inFlight[slot] = false;
+
+    size_t bytes = (size_t)pboWidth * pboHeight * 4;
+
+    std::vector<unsigned char> pixels;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= CAPTURE_MAX_QUEUED)
+        {
+            std::cout << "WARNING: Capture writer behind, frame " << slotNumber[slot]
+                      << " dropped" << std::endl;
+            return;
+        }
+        if (!pool.empty())
+        {
+            pixels.swap(pool.back());
+            pool.pop_back();
+        }
+    }
+    pixels.resize(bytes);
+
+    cacheBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+    void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (data)
+    {
+        memcpy(pixels.data(), data, bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    cacheBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!data)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(Pending());
+        queue.back().pixels.swap(pixels);
+        queue.back().width = pboWidth;
+        queue.back().height = pboHeight;
+        queue.back().number = slotNumber[slot];
+    }
+    ready.notify_one();
+}
+
+void FrameCapture::frame(int width, int height)
+{
+    if (!running || width <= 0 || height <= 0)
+        return;
+
+    if (width != pboWidth || height != pboHeight)
+    {
+        for (int i = 0; i < CAPTURE_RING_SIZE; i++)
+            collect((next + i) % CAPTURE_RING_SIZE);
+        release();
+        allocate(width, height);
+    }
+
+    int slot = next;
+    collect(slot);
+
+    cacheBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+    cacheBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    inFlight[slot] = true;
+    slotNumber[slot] = frames++;
+    next = (next + 1) % CAPTURE_RING_SIZE;
+}
+
+void FrameCapture::writer()
+{
+    TRACE_THREAD_NAME("capture writer");
+    frameAuditExemptThread();
+    for (;;)
+    {
+        Pending p;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return quit || !queue.empty(); });
+            if (queue.empty())
+                return;
+            p.pixels.swap(queue.front().pixels);
+            p.width = queue.front().width;
+            p.height = queue.front().height;
+            p.number = queue.front().number;
+            queue.pop_front();
+        }
+
+        {
+            TRACE_SCOPE("capture write");
+            write(p);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pool.push_back(std::vector<unsigned char>());
+        pool.back().swap(p.pixels);
+    }
+}
+
+void FrameCapture::write(const Pending &p)
+{
+    switch (format)
+    {
+        case CAPTURE_PPM: writePPM(p); break;
+        case CAPTURE_PNG: writePNG(p); break;
+        case CAPTURE_Y4M: writeY4M(p); break;
+    }
+}
+
+/** Open the file of one frame of a sequence. */
+static FILE *openFrame(const std::string &pattern, int number)
+{
+    char name[1024];
+    snprintf(name, sizeof(name), pattern.c_str(), number);
+    FILE *f = fopen(name, "wb");
+    if (!f)
+        std::cout << "ERROR: Could not open capture file " << name << std::endl;
+    return f;
+}
+
+void FrameCapture::writePPM(const Pending &p)
+{
+    FILE *f = openFrame(path, p.number);
+    if (!f)
+        return;
+
+    fprintf(f, "P6\n%d %d\n255\n", p.width, p.height);
+
+    // GL rows are bottom-up.
+    scratch.resize(p.width * 3);
+    for (int y = p.height - 1; y >= 0; y--)
+    {
+        const unsigned char *src = &p.pixels[(size_t)y * p.width * 4];
+        for (int x = 0; x < p.width; x++)
+        {
+            scratch[x * 3 + 0] = src[x * 4 + 0];
+            scratch[x * 3 + 1] = src[x * 4 + 1];
+            scratch[x * 3 + 2] = src[x * 4 + 2];
+        }
+        fwrite(scratch.data(), 1, scratch.size(), f);
+    }
+    fclose(f);
+}
+
+/** CRC-32 used by PNG chunks. */
+static unsigned int crc32(unsigned int crc, const unsigned char *data, size_t n)
+{
+    static unsigned int table[256];
+    static bool init = false;
+    if (!init)
+    {
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        init = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put32(unsigned char *p, unsigned int v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void writeChunk(FILE *f, const char *type, const unsigned char *data, size_t n)
+{
+    unsigned char head[8];
+    put32(head, n);
+    memcpy(head + 4, type, 4);
+    fwrite(head, 1, 8, f);
+    if (n)
+        fwrite(data, 1, n, f);
+
+    unsigned char crc[4];
+    put32(crc, crc32(crc32(0, head + 4, 4), data, n));
+    fwrite(crc, 1, 4, f);
+}
+
+/**
+ * Write PNG.
+ *
+ * The image data goes in stored (uncompressed) deflate blocks: frames are
+ * large and compressing them would make the writer the bottleneck.
+ */
+void FrameCapture::writePNG(const Pending &p)
+{
+    FILE *f = openFrame(path, p.number);
+    if (!f)
+        return;
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, 8, f);
+
+    unsigned char ihdr[13];
+    put32(ihdr, p.width);
+    put32(ihdr + 4, p.height);
+    ihdr[8] = 8;   // bit depth
+    ihdr[9] = 2;   // RGB
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    writeChunk(f, "IHDR", ihdr, 13);
+
+    // Raw scanlines: filter byte 0 followed by RGB, top row first.
+    size_t row = 1 + (size_t)p.width * 3;
+    size_t raw = row * p.height;
+    size_t blocks = (raw + 65534) / 65535;
+
+    scratch.resize(2 + raw + blocks * 5 + 4);
+    unsigned char *out = scratch.data();
+    *out++ = 0x78;
+    *out++ = 0x01;
+
+    unsigned int a = 1, b = 0;
+    size_t written = 0;
+    for (int y = p.height - 1; y >= 0; y--)
+    {
+        const unsigned char *src = &p.pixels[(size_t)y * p.width * 4];
+        for (size_t i = 0; i < row; i++)
+        {
+            if (written % 65535 == 0)
+            {
+                size_t left = std::min(raw - written, (size_t)65535);
+                *out++ = (written + left == raw) ? 1 : 0;
+                *out++ = left & 0xff;
+                *out++ = left >> 8;
+                *out++ = ~left & 0xff;
+                *out++ = (~left >> 8) & 0xff;
+            }
+            unsigned char v = i == 0 ? 0 : src[((i - 1) / 3) * 4 + (i - 1) % 3];
+            *out++ = v;
+            a = (a + v) % 65521;
+            b = (b + a) % 65521;
+            written++;
+        }
+    }
+    put32(out, (b << 16) | a);
+    out += 4;
+
+    writeChunk(f, "IDAT", scratch.data(), out - scratch.data());
+    writeChunk(f, "IEND", NULL, 0);
+    fclose(f);
+}
+
+/**
+ * Write Y4M frame.
+ *
+ * Converts to BT.601 full range YCbCr 4:2:0. The stream keeps the size of
+ * its first frame; frames of another size are skipped.
+ */
+void FrameCapture::writeY4M(const Pending &p)
+{
+    if (!streamWidth)
+    {
+        streamWidth = p.width;
+        streamHeight = p.height;
+        fprintf(stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                streamWidth, streamHeight, fps);
+    }
+    if (p.width != streamWidth || p.height != streamHeight)
+        return;
+
+    int w = p.width, h = p.height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    scratch.resize((size_t)w * h + 2 * (size_t)cw * ch);
+    unsigned char *Y = scratch.data();
+    unsigned char *U = Y + (size_t)w * h;
+    unsigned char *V = U + (size_t)cw * ch;
+
+    for (int y = 0; y < h; y++)
+    {
+        const unsigned char *src = &p.pixels[(size_t)(h - 1 - y) * w * 4];
+        for (int x = 0; x < w; x++)
+        {
+            int r = src[x * 4], g = src[x * 4 + 1], b = src[x * 4 + 2];
+            Y[y * w + x] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+        }
+    }
+    for (int y = 0; y < ch; y++)
+        for (int x = 0; x < cw; x++)
+        {
+            // Average the 2x2 block (clamped at odd borders).
+            int r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < 2; dy++)
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int sx = std::min(2 * x + dx, w - 1);
+                    int sy = std::min(2 * y + dy, h - 1);
+                    const unsigned char *s = &p.pixels[((size_t)(h - 1 - sy) * w + sx) * 4];
+                    r += s[0]; g += s[1]; b += s[2];
+                }
+            r /= 4; g /= 4; b /= 4;
+            U[y * cw + x] = (-43 * r - 85 * g + 128 * b + 32768) >> 8;
+            V[y * cw + x] = (128 * r - 107 * g - 21 * b + 32768) >> 8;
+        }
+
+    fputs("FRAME\n", stream);
+    fwrite(scratch.data(), 1, scratch.size(), stream);
+}
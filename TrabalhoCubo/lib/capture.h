@@ -0,0 +1,133 @@
+/**
+ * @file capture.h
+ * Frame capture.
+ *
+ * Records rendered frames to disk without stalling the pipeline. Frames
+ * are read into a ring of pixel buffer objects, mapped a few frames later,
+ * when the transfer has finished, and written by a separate thread.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdio.h>
+#include <GL/glew.h>
+
+
+/** Number of pixel buffer objects in the ring (frames of latency). */
+#define CAPTURE_RING_SIZE 3
+
+/** Output formats. */
+enum CaptureFormat
+{
+    /** One binary PPM file per frame. */
+    CAPTURE_PPM,
+    /** One uncompressed PNG file per frame. */
+    CAPTURE_PNG,
+    /** A single YUV4MPEG2 (4:2:0) stream. */
+    CAPTURE_Y4M
+};
+
+/**
+ * Frame capture.
+ *
+ * Call frame() after drawing and before swapping buffers.
+ */
+class FrameCapture
+{
+public:
+    FrameCapture();
+    ~FrameCapture();
+
+    /**
+     * Start capture.
+     *
+     * For PPM and PNG, path is a printf pattern receiving the frame number
+     * (e.g. "frame_%05d.ppm"). For Y4M it is the stream file name.
+     *
+     * @param path Output path or pattern.
+     * @param format Output format.
+     * @param fps Frame rate written to the Y4M header.
+     * @return False if the output could not be opened.
+     */
+    bool start(const char *path, CaptureFormat format, int fps);
+
+    /**
+     * Stop capture.
+     *
+     * Reads the frames still in flight, waits for the writer to finish and
+     * closes the output.
+     */
+    void stop();
+
+    /** Capture is running. */
+    bool active() const { return running; }
+
+    /**
+     * Capture frame.
+     *
+     * Starts the readback of the current back buffer and hands the oldest
+     * completed readback to the writer.
+     *
+     * @param width Framebuffer width.
+     * @param height Framebuffer height.
+     */
+    void frame(int width, int height);
+
+    /**
+     * Guess format.
+     *
+     * @param path File name.
+     * @return Format matching the extension (PPM if unknown).
+     */
+    static CaptureFormat formatFromPath(const char *path);
+
+private:
+    /** A frame waiting to be written. */
+    struct Pending
+    {
+        std::vector<unsigned char> pixels;
+        int width, height;
+        int number;
+    };
+
+    void allocate(int width, int height);
+    void release();
+    void collect(int slot);
+    void writer();
+    void write(const Pending &p);
+    void writePPM(const Pending &p);
+    void writePNG(const Pending &p);
+    void writeY4M(const Pending &p);
+
+    bool running;
+    CaptureFormat format;
+    std::string path;
+    int fps;
+
+    unsigned int pbo[CAPTURE_RING_SIZE];
+    bool inFlight[CAPTURE_RING_SIZE];
+    int pboWidth, pboHeight;
+    int slotNumber[CAPTURE_RING_SIZE];
+    int next;
+    int frames;
+
+    FILE *stream;
+    int streamWidth, streamHeight;
+    std::vector<unsigned char> scratch;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Pending> queue;
+    std::vector<std::vector<unsigned char> > pool;
+    bool quit;
+};
+
+#endif
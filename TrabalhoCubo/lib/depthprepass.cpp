@@ -0,0 +1,92 @@
+/**
+ * @file depthprepass.cpp
+ * Depth pre-pass.
+ *
+ * Implements the pass state changes and the shaded fragment count.
+ */
+
+#include "depthprepass.h"
+#include "utils.h"
+
+
+const char *DEPTHPREPASS_FRAGMENT_GLSL = "\n"
+"#version 330 core\n"
+"\n"
+"void main()\n"
+"{\n"
+"}\0";
+
+
+DepthPrepass::DepthPrepass()
+    : on(false), depthDone(false), shaded(0), query(0), counting(false)
+{
+    for (int i = 0; i < DEPTHPREPASS_QUERIES; i++)
+    {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+}
+
+DepthPrepass::~DepthPrepass()
+{
+    if (queries[0])
+        glDeleteQueries(DEPTHPREPASS_QUERIES, queries);
+}
+
+void DepthPrepass::beginDepth()
+{
+    if (!on)
+        return;
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    cacheDepthFunc(GL_LESS);
+    cacheDepthMask(GL_TRUE);
+    depthDone = true;
+}
+
+void DepthPrepass::beginShading()
+{
+    if (depthDone)
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        cacheDepthFunc(GL_EQUAL);
+        cacheDepthMask(GL_FALSE);
+    }
+
+    if (!queries[0])
+        glGenQueries(DEPTHPREPASS_QUERIES, queries);
+
+    // The query of this slot was issued DEPTHPREPASS_QUERIES frames ago. If
+    // it still has no result, this frame goes uncounted rather than waiting.
+    counting = false;
+    if (pending[query])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        glGetQueryObjectuiv(queries[query], GL_QUERY_RESULT, &shaded);
+        pending[query] = false;
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, queries[query]);
+    counting = true;
+}
+
+void DepthPrepass::endShading()
+{
+    if (counting)
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+        pending[query] = true;
+        query = (query + 1) % DEPTHPREPASS_QUERIES;
+        counting = false;
+    }
+
+    if (depthDone)
+    {
+        cacheDepthFunc(GL_LESS);
+        cacheDepthMask(GL_TRUE);
+        depthDone = false;
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file depthprepass.h
+ * Depth pre-pass.
+ *
+ * Draws the opaque geometry twice: first with a position-only vertex
+ * stream, a program without fragment work and color writes off, which
+ * fills the depth buffer; then with the real shaders and GL_EQUAL, so
+ * only the nearest fragment of each pixel is shaded. Overdraw then costs
+ * depth tests instead of lighting, at the price of transforming the
+ * geometry twice, which pays off for overlapping objects with expensive
+ * fragment shaders.
+ *
+ * Both passes must compute bit-identical depths: the depth vertex shader
+ * has to derive gl_Position with the same expression and inputs as the
+ * shading one, and both declare it invariant.
+ *
+ * An occlusion query around the shading pass counts the fragments that
+ * were shaded, with or without the pre-pass, so both modes can be
+ * compared.
+ */
+
+#ifndef DEPTHPREPASS_H
+#define DEPTHPREPASS_H
+
+#include <GL/glew.h>
+
+
+/** Number of occlusion queries in flight. */
+#define DEPTHPREPASS_QUERIES 3
+
+/** Fragment shader of the depth pass (writes no color). */
+extern const char *DEPTHPREPASS_FRAGMENT_GLSL;
+
+/**
+ * Depth pre-pass.
+ *
+ * Usage each frame: if enabled(), beginDepth() and draw the geometry with
+ * the depth programs; then beginShading(), draw it with the shading
+ * programs and endShading().
+ */
+class DepthPrepass
+{
+public:
+    DepthPrepass();
+    ~DepthPrepass();
+
+    /** Enable or disable the pre-pass. */
+    void setEnabled(bool enabled) { on = enabled; }
+    bool enabled() const { return on; }
+
+    /** Start the depth pass: color writes off, depth test GL_LESS with writes. */
+    void beginDepth();
+
+    /**
+     * Start the shading pass.
+     *
+     * After a depth pass, sets GL_EQUAL without depth writes. Starts
+     * counting shaded fragments either way.
+     */
+    void beginShading();
+
+    /** End the shading pass and restore GL_LESS with depth writes. */
+    void endShading();
+
+    /** Fragments shaded by the most recently measured frame. */
+    GLuint shadedFragments() const { return shaded; }
+
+private:
+    bool on;
+    bool depthDone;
+    GLuint shaded;
+
+    unsigned int queries[DEPTHPREPASS_QUERIES];
+    bool pending[DEPTHPREPASS_QUERIES];
+    int query;
+    bool counting;
+};
+
+#endif
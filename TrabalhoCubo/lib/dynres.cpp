@@ -0,0 +1,275 @@
+/**
+ * @file dynres.cpp
+ * Dynamic resolution.
+ *
+ * Implements the offscreen target, the upscale pass and the controller.
+ */
+
+#include <math.h>
+#include "dynres.h"
+#include "utils.h"
+
+
+/** Weight of a new measurement in the smoothed frame time. */
+#define DYNRES_SMOOTHING 0.1f
+/** Largest relative scale change per frame. */
+#define DYNRES_MAX_STEP 0.1f
+/** Smallest relative scale change applied (avoids jitter). */
+#define DYNRES_DEADBAND 0.02f
+
+
+/** Upscale vertex shader (full screen triangle from gl_VertexID). */
+static const char *upscale_vertex_code = "\n"
+"#version 330 core\n"
+"\n"
+"out vec2 uv;\n"
+"\n"
+"void main()\n"
+"{\n"
+"    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+"    uv = p;\n"
+"    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+"}\0";
+
+/** Upscale fragment shader (bilinear tap plus optional unsharp mask). */
+static const char *upscale_fragment_code = "\n"
+"#version 330 core\n"
+"\n"
+"in vec2 uv;\n"
+"\n"
+"out vec4 fragColor;\n"
+"\n"
+"uniform sampler2D source;\n"
+"uniform vec2 scale;\n"
+"uniform vec2 texel;\n"
+"uniform float sharpness;\n"
+"uniform vec4 bounds;\n"
+"\n"
+"// Taps stay inside the rendered rectangle: the rest of the texture holds older, larger frames.\n"
+"vec3 tap(vec2 st)\n"
+"{\n"
+"    return texture(source, clamp(st, bounds.xy, bounds.zw)).rgb;\n"
+"}\n"
+"\n"
+"void main()\n"
+"{\n"
+"    vec2 st = uv * scale;\n"
+"    vec3 c = tap(st);\n"
+"    vec3 n = tap(st + vec2(texel.x, 0.0))\n"
+"           + tap(st - vec2(texel.x, 0.0))\n"
+"           + tap(st + vec2(0.0, texel.y))\n"
+"           + tap(st - vec2(0.0, texel.y));\n"
+"    fragColor = vec4(clamp(c + sharpness * (c - 0.25 * n), 0.0, 1.0), 1.0);\n"
+"}\0";
+
+
+DynamicResolution::DynamicResolution(float budget, float minScale)
+    : on(false), filter(UPSCALE_BILINEAR), budget(budget), minScale(minScale),
+      current(1.0f), smoothed(0.0f), winWidth(0), winHeight(0),
+      fbo(0), color(0), depth(0), program(0), emptyVAO(0), query(0), timing(false)
+{
+    for (int i = 0; i < DYNRES_QUERIES; i++)
+    {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    release();
+}
+
+void DynamicResolution::setEnabled(bool enabled)
+{
+    on = enabled;
+    if (on)
+    {
+        allocate();
+    }
+    else
+    {
+        release();
+        glViewport(0, 0, winWidth, winHeight);
+    }
+}
+
+int DynamicResolution::renderWidth() const
+{
+    int w = (int)(winWidth * current + 0.5f);
+    return w < 1 ? 1 : w;
+}
+
+int DynamicResolution::renderHeight() const
+{
+    int h = (int)(winHeight * current + 0.5f);
+    return h < 1 ? 1 : h;
+}
+
+void DynamicResolution::initShader()
+{
+    program = createShaderProgram(upscale_vertex_code, upscale_fragment_code);
+    glGenVertexArrays(1, &emptyVAO);
+    glGenQueries(DYNRES_QUERIES, queries);
+}
+
+void DynamicResolution::allocate()
+{
+    if (winWidth <= 0 || winHeight <= 0)
+        return;
+    if (!program)
+        initShader();
+
+    if (!fbo)
+    {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &color);
+        glGenRenderbuffers(1, &depth);
+    }
+
+    cacheBindTexture(0, GL_TEXTURE_2D, color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, winWidth, winHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, winWidth, winHeight);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "ERROR: Dynamic resolution framebuffer incomplete" << std::endl;
+        on = false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DynamicResolution::release()
+{
+    if (fbo)
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        fbo = color = depth = 0;
+        cacheInvalidate();
+    }
+    for (int i = 0; i < DYNRES_QUERIES; i++)
+        pending[i] = false;
+}
+
+void DynamicResolution::reshape(int width, int height)
+{
+    if (winWidth > 0 && winHeight > 0 && width > 0 && height > 0)
+    {
+        // Keep the rendered pixel count: a window twice as large starts at
+        // half the area scale.
+        float ratio = sqrtf((winWidth * (float)winHeight) / (width * (float)height));
+        current = fminf(1.0f, fmaxf(minScale, current * ratio));
+    }
+
+    winWidth = width;
+    winHeight = height;
+
+    if (on)
+        allocate();
+    else
+        glViewport(0, 0, width, height);
+}
+
+void DynamicResolution::begin()
+{
+    if (!on || !fbo)
+        return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, renderWidth(), renderHeight());
+
+    // The query of this slot was issued DYNRES_QUERIES frames ago. If it
+    // still has no result, this frame goes unmeasured rather than waiting.
+    timing = false;
+    if (pending[query])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 ns;
+        glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &ns);
+        pending[query] = false;
+        control(ns / 1.0e6f);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[query]);
+    timing = true;
+}
+
+void DynamicResolution::end()
+{
+    if (!on || !fbo)
+        return;
+
+    if (timing)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[query] = true;
+        query = (query + 1) % DYNRES_QUERIES;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, winWidth, winHeight);
+
+    int w = renderWidth(), h = renderHeight();
+
+    if (filter == UPSCALE_BILINEAR)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, winWidth, winHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        return;
+    }
+
+    cacheDisable(GL_DEPTH_TEST);
+    cacheUseProgram(program);
+    cacheBindTexture(0, GL_TEXTURE_2D, color);
+    glUniform1i(glGetUniformLocation(program, "source"), 0);
+    glUniform2f(glGetUniformLocation(program, "scale"), w / (float)winWidth, h / (float)winHeight);
+    glUniform2f(glGetUniformLocation(program, "texel"), 1.0f / winWidth, 1.0f / winHeight);
+    // Centers of the first and last rendered texels, so bilinear taps do not blend in texels outside the rectangle.
+    glUniform4f(glGetUniformLocation(program, "bounds"), 0.5f / winWidth, 0.5f / winHeight,
+                (w - 0.5f) / winWidth, (h - 0.5f) / winHeight);
+    // Sharpen more the further the image is stretched.
+    glUniform1f(glGetUniformLocation(program, "sharpness"), 0.5f * (1.0f - current));
+    cacheBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    cacheEnable(GL_DEPTH_TEST);
+}
+
+/**
+ * Controller.
+ *
+ * Shading cost is proportional to pixel count, i.e. to the square of the
+ * scale, so the scale moves by the square root of budget/measured. Steps
+ * are limited per frame and small corrections are ignored.
+ */
+void DynamicResolution::control(float ms)
+{
+    if (smoothed <= 0.0f)
+        smoothed = ms;
+    else
+        smoothed += DYNRES_SMOOTHING * (ms - smoothed);
+
+    if (smoothed <= 0.0f)
+        return;
+
+    float step = sqrtf(budget / smoothed);
+    step = fminf(1.0f + DYNRES_MAX_STEP, fmaxf(1.0f - DYNRES_MAX_STEP, step));
+    if (fabsf(step - 1.0f) < DYNRES_DEADBAND)
+        return;
+
+    current = fminf(1.0f, fmaxf(minScale, current * step));
+}
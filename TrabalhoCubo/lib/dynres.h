@@ -0,0 +1,112 @@
+/**
+ * @file dynres.h
+ * Dynamic resolution.
+ *
+ * Renders the scene into an offscreen target whose resolution follows a
+ * frame time budget and upscales it to the window.
+ *
+ * The target is allocated at window size once per reshape; lowering the
+ * resolution only shrinks the viewport inside it, so the controller can
+ * change the scale every frame without reallocating.
+ */
+
+#ifndef DYNRES_H
+#define DYNRES_H
+
+#include <GL/glew.h>
+
+
+/** Number of timer queries in flight. */
+#define DYNRES_QUERIES 3
+
+/** Upscale filters. */
+enum UpscaleFilter
+{
+    /** Bilinear blit. */
+    UPSCALE_BILINEAR,
+    /** Bilinear followed by an unsharp mask. */
+    UPSCALE_SHARPEN
+};
+
+/**
+ * Dynamic resolution.
+ *
+ * Usage: reshape() from the reshape callback, begin() before clearing and
+ * end() before swapping buffers.
+ */
+class DynamicResolution
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param budget Target GPU frame time in milliseconds.
+     * @param minScale Lowest scale allowed per axis.
+     */
+    DynamicResolution(float budget = 16.0f, float minScale = 0.25f);
+    ~DynamicResolution();
+
+    /** Enable or disable the adaptive mode (disabled renders at window size). */
+    void setEnabled(bool enabled);
+    bool enabled() const { return on; }
+
+    /** Set the upscale filter. */
+    void setFilter(UpscaleFilter filter) { this->filter = filter; }
+
+    /** Set the frame time budget in milliseconds. */
+    void setBudget(float ms) { budget = ms; }
+
+    /**
+     * Window resized.
+     *
+     * Reallocates the target and rescales so the rendered pixel count stays
+     * the same; the controller then corrects from measurements.
+     *
+     * @param width Window width.
+     * @param height Window height.
+     */
+    void reshape(int width, int height);
+
+    /** Bind the offscreen target and set the scaled viewport. */
+    void begin();
+
+    /** Upscale to the window and update the controller. */
+    void end();
+
+    /** Current scale per axis. */
+    float scale() const { return current; }
+    /** Smoothed measured scene time in milliseconds. */
+    float frameTime() const { return smoothed; }
+    /** Rendered width. */
+    int renderWidth() const;
+    /** Rendered height. */
+    int renderHeight() const;
+
+private:
+    void allocate();
+    void release();
+    void initShader();
+    void control(float ms);
+
+    bool on;
+    UpscaleFilter filter;
+    float budget;
+    float minScale;
+    float current;
+    float smoothed;
+
+    int winWidth, winHeight;
+
+    unsigned int fbo;
+    unsigned int color;
+    unsigned int depth;
+    unsigned int program;
+    unsigned int emptyVAO;
+
+    unsigned int queries[DYNRES_QUERIES];
+    bool pending[DYNRES_QUERIES];
+    int query;
+    bool timing;
+};
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * @file framearena.cpp
+ * Per-frame arena allocator.
+ *
+ * Implements the block list, the per-thread arenas and their registry.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include "framearena.h"
+
+
+/** Arenas of all threads, for frameArenaEndFrame(). */
+static std::mutex registryMutex;
+static std::vector<FrameArena *> registry;
+
+
+FrameArena::FrameArena()
+    : current(0), offset(0), used(0), lastUsed(0), peak(0), mallocs(0), lastMallocs(0)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(this);
+}
+
+FrameArena::~FrameArena()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.erase(std::find(registry.begin(), registry.end(), this));
+    }
+    for (size_t i = 0; i < blocks.size(); i++)
+        free(blocks[i].data);
+}
+
+void FrameArena::addBlock(size_t minimum)
+{
+    size_t size = blocks.empty() ? FRAMEARENA_BLOCK : blocks.back().size * 2;
+    Block b = { NULL, std::max(size, minimum) };
+    b.data = (unsigned char *)malloc(b.size);
+    blocks.push_back(b);
+    mallocs++;
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    if (blocks.empty())
+        addBlock(bytes + alignment);
+
+    for (;;)
+    {
+        const Block &b = blocks[current];
+        uintptr_t base = (uintptr_t)b.data;
+        uintptr_t start = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (start + bytes <= base + b.size)
+        {
+            used += start + bytes - (base + offset);
+            offset = start + bytes - base;
+            return (void *)start;
+        }
+
+        // The rest of this block is lost for the frame.
+        used += b.size - offset;
+        if (current + 1 == blocks.size())
+            addBlock(bytes + alignment);
+        current++;
+        offset = 0;
+    }
+}
+
+void FrameArena::reset()
+{
+#ifdef FRAMEARENA_DEBUG
+    for (size_t i = 0; i <= current && i < blocks.size(); i++)
+        memset(blocks[i].data, FRAMEARENA_POISON, i == current ? offset : blocks[i].size);
+#endif
+
+    peak = std::max(peak, used);
+    lastUsed = used;
+
+    // Frames this large fit in one block from now on (the merge counts as an allocation of this frame).
+    if (blocks.size() > 1)
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            total += blocks[i].size;
+            free(blocks[i].data);
+        }
+        blocks.clear();
+        Block b = { (unsigned char *)malloc(total), total };
+        blocks.push_back(b);
+        mallocs++;
+    }
+
+    lastMallocs = mallocs;
+    current = offset = used = 0;
+    mallocs = 0;
+}
+
+FrameArenaStats FrameArena::stats() const
+{
+    FrameArenaStats s = {};
+    s.used = lastUsed;
+    s.peak = peak;
+    s.blocks = blocks.size();
+    for (size_t i = 0; i < blocks.size(); i++)
+        s.capacity += blocks[i].size;
+    s.mallocs = lastMallocs;
+    return s;
+}
+
+
+FrameArena &frameArena()
+{
+    static thread_local FrameArena arena;
+    return arena;
+}
+
+void frameArenaEndFrame()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t i = 0; i < registry.size(); i++)
+        registry[i]->reset();
+}
+
+FrameArenaStats frameArenaStats()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    FrameArenaStats total = {};
+    for (size_t i = 0; i < registry.size(); i++)
+    {
+        FrameArenaStats s = registry[i]->stats();
+        total.used += s.used;
+        total.peak += s.peak;
+        total.capacity += s.capacity;
+        total.blocks += s.blocks;
+        total.mallocs += s.mallocs;
+    }
+    return total;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file framearena.h
+ * Per-frame arena allocator.
+ *
+ * Transient render data (sort scratch, per-object draw data, temporary
+ * lists) only lives until the end of the frame. Instead of going through
+ * the heap, it is bumped out of a per-thread arena that is reset as a
+ * whole once per frame. The arena keeps its memory between frames; when a
+ * frame overflowed into extra blocks they are merged into one block of
+ * the peak size at the next reset, so steady-state frames do not call
+ * malloc at all.
+ *
+ * Every thread gets its own arena from frameArena(), with no locking.
+ * frameArenaEndFrame() resets all of them and must be called from the
+ * render thread at a point where no other thread is using its arena
+ * (e.g. after the frame's worker jobs have finished).
+ *
+ * Building with FRAMEARENA_DEBUG ("make debug") fills reset memory with
+ * FRAMEARENA_POISON, so data kept past its frame shows up as garbage.
+ */
+
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+
+/** Size of the first block of each arena. */
+#define FRAMEARENA_BLOCK (256 << 10)
+
+/** Byte written over reset memory with FRAMEARENA_DEBUG. */
+#define FRAMEARENA_POISON 0xcd
+
+/** Arena counters. */
+struct FrameArenaStats
+{
+    /** Bytes allocated in the last frame (padding included). */
+    size_t used;
+    /** Largest frame so far. */
+    size_t peak;
+    /** Bytes held in blocks. */
+    size_t capacity;
+    /** Blocks held. */
+    unsigned int blocks;
+    /** Blocks allocated from the heap in the last frame, its reset included (0 in steady state). */
+    unsigned int mallocs;
+};
+
+/**
+ * Bump allocator over a list of blocks.
+ */
+class FrameArena
+{
+public:
+    FrameArena();
+    ~FrameArena();
+
+    /**
+     * Allocate.
+     *
+     * @param bytes Size.
+     * @param alignment Power of two.
+     * @return Memory valid until the next reset.
+     */
+    void *allocate(size_t bytes, size_t alignment = alignof(max_align_t));
+
+    /** Allocate an array (not constructed). */
+    template <class T>
+    T *allocate(size_t count) { return (T *)allocate(count * sizeof(T), alignof(T)); }
+
+    /** Release everything allocated since the last reset. */
+    void reset();
+
+    /** Counters; used and mallocs refer to the last frame after reset(). */
+    FrameArenaStats stats() const;
+
+private:
+    FrameArena(const FrameArena &);
+    FrameArena &operator=(const FrameArena &);
+
+    struct Block
+    {
+        unsigned char *data;
+        size_t size;
+    };
+
+    void addBlock(size_t minimum);
+
+    std::vector<Block> blocks;
+    size_t current, offset;
+    size_t used, lastUsed, peak;
+    unsigned int mallocs, lastMallocs;
+};
+
+/** Arena of the calling thread. */
+FrameArena &frameArena();
+
+/** Reset the arenas of every thread (render thread, at the end of the frame). */
+void frameArenaEndFrame();
+
+/** Counters of all arenas summed. */
+FrameArenaStats frameArenaStats();
+
+/**
+ * Standard allocator over a frame arena.
+ *
+ * deallocate() does nothing: memory comes back at the reset. Containers
+ * using it must be created and dropped within one frame (reserve() them
+ * when the size is known, as growth leaves the old storage unused).
+ */
+template <class T>
+struct FrameAllocator
+{
+    typedef T value_type;
+
+    /** Allocates from the calling thread's arena. */
+    FrameAllocator() : arena(&frameArena()) {}
+    explicit FrameAllocator(FrameArena &arena) : arena(&arena) {}
+    template <class U>
+    FrameAllocator(const FrameAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return arena->allocate<T>(n); }
+    void deallocate(T *, size_t) {}
+
+    FrameArena *arena;
+};
+
+template <class T, class U>
+bool operator==(const FrameAllocator<T> &a, const FrameAllocator<U> &b) { return a.arena == b.arena; }
+template <class T, class U>
+bool operator!=(const FrameAllocator<T> &a, const FrameAllocator<U> &b) { return a.arena != b.arena; }
+
+/** Vector living in the frame arena. */
+template <class T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+#endif
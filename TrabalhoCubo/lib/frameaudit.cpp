@@ -0,0 +1,389 @@
+/**
+ * @file frameaudit.cpp
+ * Per-frame allocation and GL call accounting.
+ *
+ * Implements the counting operator new/delete, the GL wrappers (one table
+ * generates the counters, the wrappers and their installation) and the
+ * test mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include "frameaudit.h"
+#include "framearena.h"
+
+#ifdef FRAMEAUDIT
+#include <dlfcn.h>
+#include <GL/glew.h>
+#endif
+
+
+static unsigned long long frame = 0;
+static FrameAuditStats last = {};
+
+#ifdef FRAMEAUDIT
+
+/**
+ * GL 1.1 functions, exported by libGL itself: interposed, the real one is
+ * found with dlsym(RTLD_NEXT).
+ *
+ * X(name, return type, parameters, arguments, allowed in a steady-state frame)
+ */
+#define FRAMEAUDIT_GL11(X) \
+    X(Enable, void, (GLenum cap), (cap), 1) \
+    X(Disable, void, (GLenum cap), (cap), 1) \
+    X(Viewport, void, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), 1) \
+    X(Clear, void, (GLbitfield mask), (mask), 1) \
+    X(ClearColor, void, (GLfloat r, GLfloat g, GLfloat b, GLfloat a), (r, g, b, a), 1) \
+    X(ColorMask, void, (GLboolean r, GLboolean g, GLboolean b, GLboolean a), (r, g, b, a), 1) \
+    X(DepthMask, void, (GLboolean flag), (flag), 1) \
+    X(DepthFunc, void, (GLenum func), (func), 1) \
+    X(BlendFunc, void, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor), 1) \
+    X(DrawArrays, void, (GLenum mode, GLint first, GLsizei count), (mode, first, count), 1) \
+    X(DrawElements, void, (GLenum mode, GLsizei count, GLenum type, const GLvoid *indices), \
+      (mode, count, type, indices), 1) \
+    X(BindTexture, void, (GLenum target, GLuint texture), (target, texture), 1) \
+    X(TexParameteri, void, (GLenum target, GLenum pname, GLint param), (target, pname, param), 1) \
+    X(ReadPixels, void, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, \
+      GLvoid *pixels), (x, y, width, height, format, type, pixels), 1) \
+    X(Flush, void, (), (), 1) \
+    X(GenTextures, void, (GLsizei n, GLuint *textures), (n, textures), 0) \
+    X(DeleteTextures, void, (GLsizei n, const GLuint *textures), (n, textures), 0) \
+    X(TexImage2D, void, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, \
+      GLint border, GLenum format, GLenum type, const GLvoid *pixels), \
+      (target, level, internalformat, width, height, border, format, type, pixels), 0) \
+    X(GetIntegerv, void, (GLenum pname, GLint *params), (pname, params), 0) \
+    X(Finish, void, (), (), 0)
+
+/** Functions GLEW loads into its __glew* pointers: the pointers are swapped. */
+#define FRAMEAUDIT_GLEW(X) \
+    X(BindBuffer, void, (GLenum target, GLuint buffer), (target, buffer), 1) \
+    X(BindBufferBase, void, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer), 1) \
+    X(BindBufferRange, void, (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size), \
+      (target, index, buffer, offset, size), 1) \
+    X(BufferData, void, (GLenum target, GLsizeiptr size, const void *data, GLenum usage), \
+      (target, size, data, usage), 1) \
+    X(BufferSubData, void, (GLenum target, GLintptr offset, GLsizeiptr size, const void *data), \
+      (target, offset, size, data), 1) \
+    X(MapBufferRange, void *, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access), \
+      (target, offset, length, access), 1) \
+    X(UnmapBuffer, GLboolean, (GLenum target), (target), 1) \
+    X(CopyBufferSubData, void, (GLenum readTarget, GLenum writeTarget, GLintptr readOffset, \
+      GLintptr writeOffset, GLsizeiptr size), (readTarget, writeTarget, readOffset, writeOffset, size), 1) \
+    X(BindVertexArray, void, (GLuint array), (array), 1) \
+    X(VertexAttribPointer, void, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, \
+      const void *pointer), (index, size, type, normalized, stride, pointer), 1) \
+    X(VertexAttribIPointer, void, (GLuint index, GLint size, GLenum type, GLsizei stride, const void *pointer), \
+      (index, size, type, stride, pointer), 1) \
+    X(EnableVertexAttribArray, void, (GLuint index), (index), 1) \
+    X(VertexAttribDivisor, void, (GLuint index, GLuint divisor), (index, divisor), 1) \
+    X(UseProgram, void, (GLuint program), (program), 1) \
+    X(GetUniformLocation, GLint, (GLuint program, const GLchar *name), (program, name), 1) \
+    X(Uniform1i, void, (GLint location, GLint v0), (location, v0), 1) \
+    X(Uniform1ui, void, (GLint location, GLuint v0), (location, v0), 1) \
+    X(Uniform1f, void, (GLint location, GLfloat v0), (location, v0), 1) \
+    X(Uniform2i, void, (GLint location, GLint v0, GLint v1), (location, v0, v1), 1) \
+    X(Uniform2f, void, (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1), 1) \
+    X(Uniform3f, void, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2), (location, v0, v1, v2), 1) \
+    X(Uniform4f, void, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3), \
+      (location, v0, v1, v2, v3), 1) \
+    X(Uniform4fv, void, (GLint location, GLsizei count, const GLfloat *value), (location, count, value), 1) \
+    X(UniformMatrix4fv, void, (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value), \
+      (location, count, transpose, value), 1) \
+    X(ActiveTexture, void, (GLenum texture), (texture), 1) \
+    X(TexBuffer, void, (GLenum target, GLenum internalformat, GLuint buffer), (target, internalformat, buffer), 1) \
+    X(BindFramebuffer, void, (GLenum target, GLuint framebuffer), (target, framebuffer), 1) \
+    X(BlitFramebuffer, void, (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, \
+      GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter), \
+      (srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter), 1) \
+    X(DrawArraysInstanced, void, (GLenum mode, GLint first, GLsizei count, GLsizei instancecount), \
+      (mode, first, count, instancecount), 1) \
+    X(DrawElementsInstanced, void, (GLenum mode, GLsizei count, GLenum type, const void *indices, \
+      GLsizei instancecount), (mode, count, type, indices, instancecount), 1) \
+    X(DrawElementsBaseVertex, void, (GLenum mode, GLsizei count, GLenum type, const void *indices, \
+      GLint basevertex), (mode, count, type, indices, basevertex), 1) \
+    X(DrawElementsInstancedBaseVertex, void, (GLenum mode, GLsizei count, GLenum type, const void *indices, \
+      GLsizei instancecount, GLint basevertex), (mode, count, type, indices, instancecount, basevertex), 1) \
+    X(DrawElementsInstancedBaseVertexBaseInstance, void, (GLenum mode, GLsizei count, GLenum type, \
+      const void *indices, GLsizei instancecount, GLint basevertex, GLuint baseinstance), \
+      (mode, count, type, indices, instancecount, basevertex, baseinstance), 1) \
+    X(MultiDrawElementsIndirect, void, (GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, \
+      GLsizei stride), (mode, type, indirect, drawcount, stride), 1) \
+    X(BeginTransformFeedback, void, (GLenum primitiveMode), (primitiveMode), 1) \
+    X(EndTransformFeedback, void, (), (), 1) \
+    X(BeginQuery, void, (GLenum target, GLuint id), (target, id), 1) \
+    X(EndQuery, void, (GLenum target), (target), 1) \
+    X(QueryCounter, void, (GLuint id, GLenum target), (id, target), 1) \
+    X(GetQueryObjectiv, void, (GLuint id, GLenum pname, GLint *params), (id, pname, params), 1) \
+    X(GetQueryObjectuiv, void, (GLuint id, GLenum pname, GLuint *params), (id, pname, params), 1) \
+    X(GetQueryObjectui64v, void, (GLuint id, GLenum pname, GLuint64 *params), (id, pname, params), 1) \
+    X(FenceSync, GLsync, (GLenum condition, GLbitfield flags), (condition, flags), 1) \
+    X(ClientWaitSync, GLenum, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout), 1) \
+    X(DeleteSync, void, (GLsync sync), (sync), 1) \
+    X(GenBuffers, void, (GLsizei n, GLuint *buffers), (n, buffers), 0) \
+    X(DeleteBuffers, void, (GLsizei n, const GLuint *buffers), (n, buffers), 0) \
+    X(GenVertexArrays, void, (GLsizei n, GLuint *arrays), (n, arrays), 0) \
+    X(DeleteVertexArrays, void, (GLsizei n, const GLuint *arrays), (n, arrays), 0) \
+    X(GenFramebuffers, void, (GLsizei n, GLuint *framebuffers), (n, framebuffers), 0) \
+    X(DeleteFramebuffers, void, (GLsizei n, const GLuint *framebuffers), (n, framebuffers), 0) \
+    X(GenRenderbuffers, void, (GLsizei n, GLuint *renderbuffers), (n, renderbuffers), 0) \
+    X(DeleteRenderbuffers, void, (GLsizei n, const GLuint *renderbuffers), (n, renderbuffers), 0) \
+    X(RenderbufferStorage, void, (GLenum target, GLenum internalformat, GLsizei width, GLsizei height), \
+      (target, internalformat, width, height), 0) \
+    X(GenQueries, void, (GLsizei n, GLuint *ids), (n, ids), 0) \
+    X(DeleteQueries, void, (GLsizei n, const GLuint *ids), (n, ids), 0) \
+    X(CreateProgram, GLuint, (), (), 0) \
+    X(CreateShader, GLuint, (GLenum type), (type), 0) \
+    X(CompileShader, void, (GLuint shader), (shader), 0) \
+    X(LinkProgram, void, (GLuint program), (program), 0) \
+    X(GetInteger64v, void, (GLenum pname, GLint64 *data), (pname, data), 0)
+
+#define FRAMEAUDIT_INDEX(name, ret, params, args, steady) CALL_##name,
+enum
+{
+    FRAMEAUDIT_GL11(FRAMEAUDIT_INDEX)
+    FRAMEAUDIT_GLEW(FRAMEAUDIT_INDEX)
+    CALL_COUNT
+};
+
+#define FRAMEAUDIT_NAME(name, ret, params, args, steady) "gl" #name,
+static const char *const callNames[CALL_COUNT] = { FRAMEAUDIT_GL11(FRAMEAUDIT_NAME) FRAMEAUDIT_GLEW(FRAMEAUDIT_NAME) };
+
+#define FRAMEAUDIT_STEADY(name, ret, params, args, steady) steady,
+static const bool callSteady[CALL_COUNT] = { FRAMEAUDIT_GL11(FRAMEAUDIT_STEADY) FRAMEAUDIT_GLEW(FRAMEAUDIT_STEADY) };
+
+
+/** Set on threads left out of the counts. */
+static thread_local bool exempt = false;
+
+static std::atomic<unsigned int> allocations(0), frees(0);
+static std::atomic<size_t> bytes(0);
+
+/** Calls in the current and in the last frame (only the render thread issues counted GL calls). */
+static unsigned int calls[CALL_COUNT], lastCalls[CALL_COUNT];
+
+/** Frames to audit after the warm-up (0: not in test mode). */
+static unsigned int testFrames = 0;
+static unsigned int failedFrames = 0, minCalls = ~0u, maxCalls = 0;
+
+
+static void *countedAlloc(size_t size, size_t alignment)
+{
+    if (!exempt)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (alignment <= alignof(max_align_t))
+        return malloc(size ? size : 1);
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void countedFree(void *p)
+{
+    if (p && !exempt)
+        frees.fetch_add(1, std::memory_order_relaxed);
+    free(p);
+}
+
+// The array, nothrow and sized forms call these by default.
+void *operator new(size_t size)
+{
+    void *p = countedAlloc(size, 0);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    countedFree(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    countedFree(p);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    void *p = countedAlloc(size, (size_t)alignment);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    countedFree(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+    countedFree(p);
+}
+
+
+static inline void countCall(int function)
+{
+    if (!exempt)
+        calls[function]++;
+}
+
+/** libGL's own definition of an interposed function. */
+static void *realFunction(const char *name)
+{
+    void *f = dlsym(RTLD_NEXT, name);
+    if (!f)
+    {
+        // Linked with --as-needed and nothing else referring to libGL directly.
+        static void *libGL = dlopen("libGL.so.1", RTLD_LAZY | RTLD_GLOBAL);
+        f = libGL ? dlsym(libGL, name) : NULL;
+    }
+    if (!f)
+    {
+        printf("ERROR: %s not found in libGL\n", name);
+        abort();
+    }
+    return f;
+}
+
+#define FRAMEAUDIT_INTERPOSE(name, ret, params, args, steady) \
+    extern "C" ret GLAPIENTRY gl##name params \
+    { \
+        typedef ret (GLAPIENTRY *Function) params; \
+        static const Function real = (Function)realFunction("gl" #name); \
+        countCall(CALL_##name); \
+        return real args; \
+    }
+FRAMEAUDIT_GL11(FRAMEAUDIT_INTERPOSE)
+
+#define FRAMEAUDIT_WRAP(name, ret, params, args, steady) \
+    static decltype(__glew##name) real##name; \
+    static ret GLAPIENTRY audit##name params \
+    { \
+        countCall(CALL_##name); \
+        return real##name args; \
+    }
+FRAMEAUDIT_GLEW(FRAMEAUDIT_WRAP)
+
+#define FRAMEAUDIT_INSTALL(name, ret, params, args, steady) \
+    if (__glew##name && __glew##name != audit##name) \
+    { \
+        real##name = __glew##name; \
+        __glew##name = audit##name; \
+    }
+
+#endif
+
+
+bool frameAuditEnabled()
+{
+#ifdef FRAMEAUDIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void frameAuditInit()
+{
+    const char *value = getenv(FRAMEAUDIT_ENV);
+    int requested = value ? atoi(value) : 0;
+
+#ifdef FRAMEAUDIT
+    FRAMEAUDIT_GLEW(FRAMEAUDIT_INSTALL)
+    if (requested > 0)
+    {
+        testFrames = requested;
+        printf("audit: %u frames after %d of warm-up\n", testFrames, FRAMEAUDIT_WARMUP);
+    }
+#else
+    if (requested > 0)
+        printf("WARNING: %s is set but the program was built without FRAMEAUDIT (make audit)\n", FRAMEAUDIT_ENV);
+#endif
+}
+
+void frameAuditExemptThread()
+{
+#ifdef FRAMEAUDIT
+    exempt = true;
+#endif
+}
+
+FrameAuditStats frameAuditEndFrame()
+{
+    FrameAuditStats s = {};
+    s.frame = frame++;
+
+#ifdef FRAMEAUDIT
+    s.allocations = allocations.exchange(0);
+    s.frees = frees.exchange(0);
+    s.bytes = bytes.exchange(0);
+    s.arenaMallocs = frameArenaStats().mallocs;
+    for (int f = 0; f < CALL_COUNT; f++)
+    {
+        s.glCalls += calls[f];
+        if (!callSteady[f])
+            s.forbiddenCalls += calls[f];
+        lastCalls[f] = calls[f];
+        calls[f] = 0;
+    }
+#endif
+    last = s;
+
+#ifdef FRAMEAUDIT
+    if (testFrames == 0 || s.frame < FRAMEAUDIT_WARMUP)
+        return s;
+
+    printf("audit: frame %llu: %u allocations (%zu bytes), %u arena mallocs, %u frees, %u GL calls\n", s.frame,
+           s.allocations, s.bytes, s.arenaMallocs, s.frees, s.glCalls);
+    minCalls = std::min(minCalls, s.glCalls);
+    maxCalls = std::max(maxCalls, s.glCalls);
+
+    if (s.allocations > 0 || s.arenaMallocs > 0 || s.forbiddenCalls > 0)
+    {
+        failedFrames++;
+        if (s.allocations > 0)
+            printf("ERROR: frame %llu allocated %u times after warm-up\n", s.frame, s.allocations);
+        if (s.arenaMallocs > 0)
+            printf("ERROR: frame %llu grew the frame arenas with %u mallocs after warm-up\n", s.frame,
+                   s.arenaMallocs);
+        for (int f = 0; f < CALL_COUNT; f++)
+            if (!callSteady[f] && lastCalls[f] > 0)
+                printf("ERROR: frame %llu called %s %u times after warm-up\n", s.frame, callNames[f], lastCalls[f]);
+    }
+
+    if (s.frame + 1 >= FRAMEAUDIT_WARMUP + (unsigned long long)testFrames)
+    {
+        printf("audit: %u frames, %u failed, %u-%u GL calls per frame: %s\n", testFrames, failedFrames, minCalls,
+               maxCalls, failedFrames ? "FAILED" : "passed");
+        exit(failedFrames ? 1 : 0);
+    }
+#endif
+    return s;
+}
+
+FrameAuditStats frameAuditLastFrame()
+{
+    return last;
+}
+
+void frameAuditPrintCalls(unsigned int max)
+{
+#ifdef FRAMEAUDIT
+    int order[CALL_COUNT];
+    for (int f = 0; f < CALL_COUNT; f++)
+        order[f] = f;
+    std::sort(order, order + CALL_COUNT, [](int a, int b) { return lastCalls[a] > lastCalls[b]; });
+
+    for (unsigned int i = 0; i < max && i < CALL_COUNT && lastCalls[order[i]] > 0; i++)
+        printf("  %-44s %6u%s\n", callNames[order[i]], lastCalls[order[i]],
+               callSteady[order[i]] ? "" : " (not allowed after warm-up)");
+#else
+    (void)max;
+#endif
+}
@@ -0,0 +1,92 @@
+/**
+ * @file frameaudit.h
+ * Per-frame allocation and GL call accounting.
+ *
+ * Built with FRAMEAUDIT defined ("make audit"), the global operator
+ * new/delete are replaced by counting versions and the GL entry points
+ * the renderer uses are wrapped: the ones GLEW loads by swapping its
+ * function pointers in frameAuditInit(), the GL 1.1 exports by
+ * interposing them. Allocations, bytes and calls per function are
+ * summed per frame and closed by frameAuditEndFrame().
+ *
+ * With GL calls that should never happen in a steady-state frame (object
+ * creation and deletion, shader compiles, queries that stall the
+ * pipeline) and any allocation, a frame fails the audit. Allocations
+ * include the blocks the frame arenas took from malloc, read from
+ * frameArenaStats(), so frameArenaEndFrame() must run before
+ * frameAuditEndFrame(). When FRAMEAUDIT_ENV is set to a frame count, the
+ * program runs that many frames after FRAMEAUDIT_WARMUP frames of
+ * warm-up, prints the counts of each one and exits with status 1 if any
+ * failed (0 otherwise).
+ *
+ * Threads doing background work that is not part of a frame (asset
+ * decoding, capture writing) call frameAuditExemptThread().
+ *
+ * Without FRAMEAUDIT nothing is hooked and the counts stay zero.
+ */
+
+#ifndef FRAMEAUDIT_H
+#define FRAMEAUDIT_H
+
+#include <stddef.h>
+
+
+/** Environment variable with the number of frames to audit (test mode). */
+#define FRAMEAUDIT_ENV "CUBO_AUDIT"
+
+/** Frames not audited at the start (shader compiles, loading, first uploads). */
+#define FRAMEAUDIT_WARMUP 120
+
+/** Counts of one frame. */
+struct FrameAuditStats
+{
+    /** Frame number (from 0). */
+    unsigned long long frame;
+    /** operator new calls. */
+    unsigned int allocations;
+    /** Bytes requested from operator new. */
+    size_t bytes;
+    /** Blocks the frame arenas allocated with malloc (FrameArenaStats::mallocs). */
+    unsigned int arenaMallocs;
+    /** operator delete calls (null pointers excluded). */
+    unsigned int frees;
+    /** Calls to wrapped GL functions. */
+    unsigned int glCalls;
+    /** Calls to GL functions not allowed in a steady-state frame. */
+    unsigned int forbiddenCalls;
+};
+
+/** Whether the program was built with FRAMEAUDIT. */
+bool frameAuditEnabled();
+
+/**
+ * Hook the GL functions and read FRAMEAUDIT_ENV.
+ *
+ * Call after glewInit(), on the render thread.
+ */
+void frameAuditInit();
+
+/** Leave the calling thread's allocations and GL calls out of the counts. */
+void frameAuditExemptThread();
+
+/**
+ * Close the frame (render thread, once per frame).
+ *
+ * In test mode also checks the frame and ends the program after the last
+ * one.
+ *
+ * @return Counts of the frame just closed.
+ */
+FrameAuditStats frameAuditEndFrame();
+
+/** Counts of the last closed frame. */
+FrameAuditStats frameAuditLastFrame();
+
+/**
+ * Print the GL functions called in the last closed frame, most called first.
+ *
+ * @param max Most functions printed.
+ */
+void frameAuditPrintCalls(unsigned int max);
+
+#endif
@@ -0,0 +1,172 @@
+/**
+ * @file gldebug.cpp
+ * KHR_debug output, object labels and debug groups.
+ *
+ * Implements the message routing, the per-id repeat limit and the
+ * per-frame performance counter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include "gldebug.h"
+
+
+static bool active = false;
+
+/** Guards the repeat counts (the callback may come from any thread with a debug context). */
+static std::mutex repeatMutex;
+static std::map<GLuint, unsigned int> repeats;
+
+static std::atomic<unsigned int> messages(0), suppressed(0), errors(0), performance(0), framePerformance(0);
+static unsigned int lastFramePerformance = 0, peakFramePerformance = 0;
+
+
+static const char *sourceName(GLenum source)
+{
+    switch (source)
+    {
+        case GL_DEBUG_SOURCE_API:             return "api";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY:     return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION:     return "application";
+        default:                              return "other";
+    }
+}
+
+static const char *typeName(GLenum type)
+{
+    switch (type)
+    {
+        case GL_DEBUG_TYPE_ERROR:               return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+        case GL_DEBUG_TYPE_MARKER:              return "marker";
+        default:                                return "other";
+    }
+}
+
+/** Log prefix of a message: by type first, then by severity. */
+static const char *route(GLenum type, GLenum severity)
+{
+    if (type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH)
+        return "ERROR";
+    if (type == GL_DEBUG_TYPE_PERFORMANCE)
+        return "PERFORMANCE";
+    if (type == GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR || type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR ||
+        type == GL_DEBUG_TYPE_PORTABILITY || severity == GL_DEBUG_SEVERITY_MEDIUM)
+        return "WARNING";
+    return "INFO";
+}
+
+static void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei,
+                                     const GLchar *message, const void *)
+{
+    messages++;
+    if (type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH)
+        errors++;
+    if (type == GL_DEBUG_TYPE_PERFORMANCE)
+    {
+        performance++;
+        framePerformance++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(repeatMutex);
+        unsigned int &seen = repeats[id];
+        if (seen++ >= GLDEBUG_REPEAT_LIMIT)
+        {
+            suppressed++;
+            return;
+        }
+        if (seen == GLDEBUG_REPEAT_LIMIT)
+            printf("%s: GL %s %s #%u: %s (further repeats not shown)\n", route(type, severity), sourceName(source),
+                   typeName(type), id, message);
+        else
+            printf("%s: GL %s %s #%u: %s\n", route(type, severity), sourceName(source), typeName(type), id,
+                   message);
+    }
+}
+
+
+bool debugOutputRequested()
+{
+    const char *value = getenv(GLDEBUG_ENV);
+    return value && *value && strcmp(value, "0") != 0;
+}
+
+bool debugOutputInit()
+{
+    if (!GLEW_KHR_debug && !GLEW_VERSION_4_3)
+    {
+        printf("WARNING: GL debug output requested but KHR_debug is not supported\n");
+        return false;
+    }
+
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+    if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+    {
+        printf("WARNING: GL debug output requested but the context is not a debug context\n");
+        return false;
+    }
+
+    glEnable(GL_DEBUG_OUTPUT);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(debugCallback, NULL);
+    // Everything but notifications (the groups' own push/pop messages are notifications too).
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+
+    active = true;
+    printf("GL debug output on (%s)\n", GLDEBUG_ENV);
+    return true;
+}
+
+void debugOutputEndFrame()
+{
+    if (!active)
+        return;
+    lastFramePerformance = framePerformance.exchange(0);
+    peakFramePerformance = std::max(peakFramePerformance, lastFramePerformance);
+}
+
+DebugOutputStats debugOutputStats()
+{
+    DebugOutputStats s = {};
+    s.active = active;
+    s.messages = messages;
+    s.suppressed = suppressed;
+    s.errors = errors;
+    s.performance = performance;
+    s.framePerformance = lastFramePerformance;
+    s.peakFramePerformance = peakFramePerformance;
+    return s;
+}
+
+void debugLabel(GLenum identifier, GLuint name, const char *label)
+{
+    if (active && name)
+        glObjectLabel(identifier, name, -1, label);
+}
+
+
+DebugGroup::DebugGroup(const char *name)
+    : pushed(active)
+{
+    if (pushed)
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+DebugGroup::~DebugGroup()
+{
+    if (pushed)
+        glPopDebugGroup();
+}
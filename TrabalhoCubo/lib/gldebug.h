@@ -0,0 +1,109 @@
+/**
+ * @file gldebug.h
+ * KHR_debug output, object labels and debug groups.
+ *
+ * Debug output is opt-in: when GLDEBUG_ENV is set in the environment the
+ * program asks GLUT for a debug context and debugOutputInit() installs a
+ * callback that routes driver messages by type and severity to stdout
+ * ("ERROR:", "WARNING:", "PERFORMANCE:", "INFO:"). Notifications are
+ * disabled at the source. Each message id is printed at most
+ * GLDEBUG_REPEAT_LIMIT times; later repeats are only counted.
+ *
+ * GL_DEBUG_TYPE_PERFORMANCE messages (stalls, slow paths, shader
+ * recompiles) are also counted per frame, so a regression shows up in the
+ * frame statistics even after the text stopped being printed.
+ *
+ * Output is synchronous, so a message is delivered inside the GL call
+ * that caused it and lands next to it in the log and in a trace. Labels
+ * and groups make the driver's messages and GPU debuggers name the
+ * objects and passes; without an active debug context every function
+ * here returns at once.
+ */
+
+#ifndef GLDEBUG_H
+#define GLDEBUG_H
+
+#include <GL/glew.h>
+
+
+/** Environment variable that turns debug output on. */
+#define GLDEBUG_ENV "CUBO_GL_DEBUG"
+
+/** Times the same message id is printed before it is only counted. */
+#define GLDEBUG_REPEAT_LIMIT 4
+
+/** Counters of the debug output. */
+struct DebugOutputStats
+{
+    /** Whether the callback is installed. */
+    bool active;
+    /** Messages received (printed or not). */
+    unsigned int messages;
+    /** Messages not printed because their id repeated too often. */
+    unsigned int suppressed;
+    /** Errors (GL_DEBUG_TYPE_ERROR or high severity). */
+    unsigned int errors;
+    /** Performance warnings since the start. */
+    unsigned int performance;
+    /** Performance warnings in the last frame. */
+    unsigned int framePerformance;
+    /** Most performance warnings in one frame. */
+    unsigned int peakFramePerformance;
+};
+
+/**
+ * Whether debug output was requested (GLDEBUG_ENV set and not "0").
+ *
+ * Checked before the window is created, to add GLUT_DEBUG to the context
+ * flags.
+ */
+bool debugOutputRequested();
+
+/**
+ * Install the debug callback on the current context.
+ *
+ * Needs a debug context and KHR_debug (or GL 4.3); prints why otherwise.
+ *
+ * @return true if debug output is active.
+ */
+bool debugOutputInit();
+
+/** Close the frame's performance count (render thread, once per frame). */
+void debugOutputEndFrame();
+
+/** Counters; framePerformance refers to the last closed frame. */
+DebugOutputStats debugOutputStats();
+
+/**
+ * Name a GL object in driver messages and debuggers.
+ *
+ * The object must exist: VAOs, buffers and textures only do after their
+ * first bind.
+ *
+ * @param identifier GL_BUFFER, GL_VERTEX_ARRAY, GL_PROGRAM, GL_TEXTURE, ...
+ * @param name Object name.
+ * @param label Text (copied by GL).
+ */
+void debugLabel(GLenum identifier, GLuint name, const char *label);
+
+/**
+ * Debug group around a block of GL commands (a pass).
+ *
+ * Groups nest; messages raised inside are attributed to them and frame
+ * debuggers show the commands grouped by pass.
+ */
+class DebugGroup
+{
+public:
+    /** @param name Text of the group (copied by GL). */
+    explicit DebugGroup(const char *name);
+    ~DebugGroup();
+
+private:
+    DebugGroup(const DebugGroup &);
+    DebugGroup &operator=(const DebugGroup &);
+
+    bool pushed;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file gpuanim.cpp
+ * GPU-driven animation.
+ *
+ * Implements the instance buffer and the shader side of the animation.
+ */
+
+#include <stdlib.h>
+#include "gpuanim.h"
+#include "utils.h"
+
+
+const char *GPUANIM_GLSL = "\n"
+"uniform float time;\n"
+"uniform vec2 bounds;\n"
+"\n"
+"// Position moving at constant speed and reflected by walls at lo and hi:\n"
+"// a triangle wave of the unbounded position.\n"
+"float bounce(float p0, float v, float lo, float hi)\n"
+"{\n"
+"    float w = max(hi - lo, 1e-4);\n"
+"    float u = mod(p0 + v * time - lo, 2.0 * w);\n"
+"    return lo + (u < w ? u : 2.0 * w - u);\n"
+"}\n"
+"\n"
+"mat4 animModel(vec4 motion, vec4 spin, vec4 phase)\n"
+"{\n"
+"    float s = spin.w;\n"
+"    vec3 a = radians(phase.xyz + spin.xyz * time);\n"
+"    vec3 c = cos(a);\n"
+"    vec3 n = sin(a);\n"
+"\n"
+"    // Ry * Rx * Rz in closed form, by columns.\n"
+"    vec3 r0 = vec3(c.y * c.z + n.y * n.x * n.z, c.x * n.z, c.y * n.x * n.z - n.y * c.z);\n"
+"    vec3 r1 = vec3(n.y * n.x * c.z - c.y * n.z, c.x * c.z, n.y * n.z + c.y * n.x * c.z);\n"
+"    vec3 r2 = vec3(n.y * c.x, -n.x, c.y * c.x);\n"
+"\n"
+"    vec2 p = vec2(bounce(motion.x, motion.z, -bounds.x + s, bounds.x - s),\n"
+"                  bounce(motion.y, motion.w, -bounds.y + s, bounds.y - s));\n"
+"\n"
+"    return mat4(vec4(r0 * s, 0.0), vec4(r1 * s, 0.0), vec4(r2 * s, 0.0), vec4(p, 0.0, 1.0));\n"
+"}\n";
+
+
+GpuAnimation::GpuAnimation()
+    : vbo(0), instanceCount(0)
+{
+}
+
+GpuAnimation::~GpuAnimation()
+{
+    if (vbo)
+        glDeleteBuffers(1, &vbo);
+}
+
+void GpuAnimation::setInstances(const std::vector<AnimInstance> &instances)
+{
+    if (!vbo)
+        glGenBuffers(1, &vbo);
+    cacheBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(AnimInstance), instances.data(), GL_STATIC_DRAW);
+    instanceCount = instances.size();
+}
+
+void GpuAnimation::setupVAO(unsigned int vao, int first)
+{
+    cacheBindVertexArray(vao);
+    cacheBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for (int i = 0; i < 3; i++)
+    {
+        glVertexAttribPointer(first + i, 4, GL_FLOAT, GL_FALSE, sizeof(AnimInstance),
+                              (void *)(i * 4 * sizeof(float)));
+        glEnableVertexAttribArray(first + i);
+        glVertexAttribDivisor(first + i, 1);
+    }
+}
+
+/** Uniform random number in [lo, hi]. */
+static float uniform(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+std::vector<AnimInstance> GpuAnimation::random(int count, float hLimit, float vLimit, float speed)
+{
+    std::vector<AnimInstance> instances(count);
+    for (int i = 0; i < count; i++)
+    {
+        AnimInstance &a = instances[i];
+        a.motion[0] = uniform(-hLimit, hLimit);
+        a.motion[1] = uniform(-vLimit, vLimit);
+        a.motion[2] = uniform(-speed, speed);
+        a.motion[3] = uniform(-speed, speed);
+        a.spin[0] = uniform(-60.0f, 60.0f);
+        a.spin[1] = uniform(-60.0f, 60.0f);
+        a.spin[2] = uniform(-60.0f, 60.0f);
+        a.spin[3] = uniform(0.02f, 0.08f);
+        a.phase[0] = uniform(0.0f, 360.0f);
+        a.phase[1] = uniform(0.0f, 360.0f);
+        a.phase[2] = uniform(0.0f, 360.0f);
+        a.phase[3] = 0.0f;
+    }
+    return instances;
+}
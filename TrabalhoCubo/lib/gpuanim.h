@@ -0,0 +1,91 @@
+/**
+ * @file gpuanim.h
+ * GPU-driven animation.
+ *
+ * Each object is described by static per-instance parameters (initial
+ * position, velocity, initial angles, angular velocities and size). The
+ * vertex shader rebuilds rotation and the wall-bounced position from a
+ * single time uniform, so per-frame CPU work and uploads do not grow with
+ * the number of objects.
+ *
+ * Vertex shaders include GPUANIM_GLSL and call animModel() with the three
+ * per-instance attributes bound by GpuAnimation::setupVAO().
+ */
+
+#ifndef GPUANIM_H
+#define GPUANIM_H
+
+#include <vector>
+#include <GL/glew.h>
+
+
+/** Animation parameters of one object. */
+struct AnimInstance
+{
+    /** Initial position (x, y) and velocity (x, y) per second. */
+    float motion[4];
+    /** Angular velocities (x, y, z) in degrees per second, and size. */
+    float spin[4];
+    /** Initial angles (x, y, z) in degrees, and padding. */
+    float phase[4];
+};
+
+/**
+ * GLSL animation function.
+ *
+ * Declares the uniforms time (seconds) and bounds (half extent of the
+ * visible area at z = 0), and
+ * mat4 animModel(vec4 motion, vec4 spin, vec4 phase),
+ * returning T * Ry * Rx * Rz * S as the cube program builds it.
+ */
+extern const char *GPUANIM_GLSL;
+
+/**
+ * GPU animation instances.
+ */
+class GpuAnimation
+{
+public:
+    GpuAnimation();
+    ~GpuAnimation();
+
+    /**
+     * Upload instances.
+     *
+     * Done once; nothing is uploaded per frame.
+     *
+     * @param instances Instance parameters.
+     */
+    void setInstances(const std::vector<AnimInstance> &instances);
+
+    /**
+     * Bind instance attributes.
+     *
+     * Sets motion, spin and phase at locations first, first + 1 and
+     * first + 2 of the VAO, advancing once per instance.
+     *
+     * @param vao Vertex array object.
+     * @param first First attribute location.
+     */
+    void setupVAO(unsigned int vao, int first);
+
+    /**
+     * Fill with random instances.
+     *
+     * @param count Number of instances.
+     * @param hLimit Horizontal half extent.
+     * @param vLimit Vertical half extent.
+     * @param speed Largest speed in units per second.
+     * @return Generated instances.
+     */
+    static std::vector<AnimInstance> random(int count, float hLimit, float vLimit, float speed);
+
+    /** Number of instances. */
+    int count() const { return instanceCount; }
+
+private:
+    unsigned int vbo;
+    int instanceCount;
+};
+
+#endif
@@ -0,0 +1,350 @@
+/**
+ * @file gpuheap.cpp
+ * GPU buffer suballocation.
+ *
+ * Implements the free list arenas and the mesh heap.
+ */
+
+#include <algorithm>
+#include "gpuheap.h"
+#include "utils.h"
+
+
+/** Round up to a multiple (not necessarily a power of two). */
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+
+GpuBufferArena::GpuBufferArena(size_t capacity, GLenum usage)
+    : usage(usage), capacity(capacity), name(0), moves(0)
+{
+}
+
+GpuBufferArena::~GpuBufferArena()
+{
+    if (name)
+        glDeleteBuffers(1, &name);
+}
+
+void GpuBufferArena::create()
+{
+    if (name)
+        return;
+
+    // Filled through GL_COPY_WRITE_BUFFER so no VAO's element binding changes.
+    glGenBuffers(1, &name);
+    cacheBindBuffer(GL_COPY_WRITE_BUFFER, name);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, usage);
+    addFree(0, capacity);
+}
+
+GLuint GpuBufferArena::buffer()
+{
+    create();
+    return name;
+}
+
+void GpuBufferArena::addFree(size_t offset, size_t size)
+{
+    // Merge with the free neighbours on both sides.
+    std::map<size_t, size_t>::iterator next = freeByOffset.lower_bound(offset);
+    if (next != freeByOffset.end() && next->first == offset + size)
+    {
+        size_t nextSize = next->second;
+        removeFree(next->first, nextSize);
+        size += nextSize;
+    }
+    next = freeByOffset.lower_bound(offset);
+    if (next != freeByOffset.begin())
+    {
+        std::map<size_t, size_t>::iterator prev = next;
+        --prev;
+        if (prev->first + prev->second == offset)
+        {
+            size_t prevOffset = prev->first, prevSize = prev->second;
+            removeFree(prevOffset, prevSize);
+            offset = prevOffset;
+            size += prevSize;
+        }
+    }
+
+    freeByOffset[offset] = size;
+    freeBySize.insert(std::make_pair(size, offset));
+}
+
+void GpuBufferArena::removeFree(size_t offset, size_t size)
+{
+    freeByOffset.erase(offset);
+    std::pair<std::multimap<size_t, size_t>::iterator, std::multimap<size_t, size_t>::iterator> range =
+        freeBySize.equal_range(size);
+    for (std::multimap<size_t, size_t>::iterator it = range.first; it != range.second; ++it)
+        if (it->second == offset)
+        {
+            freeBySize.erase(it);
+            return;
+        }
+}
+
+void GpuBufferArena::copy(GLuint from, size_t fromOffset, GLuint to, size_t toOffset, size_t bytes)
+{
+    cacheBindBuffer(GL_COPY_READ_BUFFER, from);
+    cacheBindBuffer(GL_COPY_WRITE_BUFFER, to);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, fromOffset, toOffset, bytes);
+}
+
+void GpuBufferArena::grow(size_t minimum)
+{
+    size_t end = 0;
+    for (size_t i = 0; i < blocks.size(); i++)
+        if (blocks[i].live)
+            end = std::max(end, blocks[i].offset + blocks[i].size);
+
+    size_t grown = std::max(capacity * 2, capacity + minimum);
+
+    // Reallocating the storage keeps the name, so VAOs stay valid; the
+    // contents go through a scratch buffer.
+    GLuint scratch = 0;
+    if (end)
+    {
+        glGenBuffers(1, &scratch);
+        cacheBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+        glBufferData(GL_COPY_WRITE_BUFFER, end, NULL, GL_STREAM_COPY);
+        copy(name, 0, scratch, 0, end);
+    }
+
+    cacheBindBuffer(GL_COPY_WRITE_BUFFER, name);
+    glBufferData(GL_COPY_WRITE_BUFFER, grown, NULL, usage);
+
+    if (end)
+    {
+        copy(scratch, 0, name, 0, end);
+        glDeleteBuffers(1, &scratch);
+    }
+
+    addFree(capacity, grown - capacity);
+    capacity = grown;
+}
+
+int GpuBufferArena::allocate(size_t size, size_t alignment)
+{
+    create();
+    if (size == 0)
+        size = 1;
+    if (alignment == 0)
+        alignment = 1;
+
+    for (;;)
+    {
+        // Smallest free block that still fits after aligning its start.
+        for (std::multimap<size_t, size_t>::iterator it = freeBySize.lower_bound(size); it != freeBySize.end(); ++it)
+        {
+            size_t start = it->second, end = start + it->first;
+            size_t aligned = alignUp(start, alignment);
+            if (aligned + size > end)
+                continue;
+
+            removeFree(start, end - start);
+            if (aligned > start)
+                addFree(start, aligned - start);
+            if (aligned + size < end)
+                addFree(aligned + size, end - aligned - size);
+
+            Block b = { aligned, size, alignment, true };
+            int handle;
+            if (!unused.empty())
+            {
+                handle = unused.back();
+                unused.pop_back();
+                blocks[handle] = b;
+            }
+            else
+            {
+                handle = blocks.size();
+                blocks.push_back(b);
+            }
+            return handle;
+        }
+
+        grow(size + alignment);
+    }
+}
+
+void GpuBufferArena::release(int handle)
+{
+    Block &b = blocks[handle];
+    if (!b.live)
+        return;
+
+    b.live = false;
+    addFree(b.offset, b.size);
+    unused.push_back(handle);
+}
+
+void GpuBufferArena::upload(int handle, const void *data, size_t bytes, size_t at)
+{
+    cacheBindBuffer(GL_COPY_WRITE_BUFFER, name);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, blocks[handle].offset + at, bytes, data);
+}
+
+bool GpuBufferArena::defragment()
+{
+    std::vector<int> live;
+    for (size_t i = 0; i < blocks.size(); i++)
+        if (blocks[i].live)
+            live.push_back(i);
+    std::sort(live.begin(), live.end(), [this](int a, int b) { return blocks[a].offset < blocks[b].offset; });
+
+    // Packed offsets, keeping each range's alignment.
+    std::vector<size_t> packed(live.size());
+    size_t cursor = 0;
+    unsigned int moved = 0;
+    for (size_t i = 0; i < live.size(); i++)
+    {
+        const Block &b = blocks[live[i]];
+        packed[i] = alignUp(cursor, b.alignment);
+        cursor = packed[i] + b.size;
+        moved += packed[i] != b.offset;
+    }
+    if (!moved)
+        return false;
+
+    // Ranges only move down, but may overlap their old place: gather them
+    // in a scratch buffer and copy the packed result back in one go.
+    GLuint scratch;
+    glGenBuffers(1, &scratch);
+    cacheBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+    glBufferData(GL_COPY_WRITE_BUFFER, cursor, NULL, GL_STREAM_COPY);
+    for (size_t i = 0; i < live.size(); i++)
+        copy(name, blocks[live[i]].offset, scratch, packed[i], blocks[live[i]].size);
+    copy(scratch, 0, name, 0, cursor);
+    glDeleteBuffers(1, &scratch);
+
+    freeByOffset.clear();
+    freeBySize.clear();
+    size_t end = 0;
+    for (size_t i = 0; i < live.size(); i++)
+    {
+        Block &b = blocks[live[i]];
+        if (packed[i] > end)
+            addFree(end, packed[i] - end);
+        b.offset = packed[i];
+        end = b.offset + b.size;
+    }
+    if (end < capacity)
+        addFree(end, capacity - end);
+
+    moves += moved;
+    return true;
+}
+
+GpuArenaStats GpuBufferArena::stats() const
+{
+    GpuArenaStats s = {};
+    s.capacity = capacity;
+    s.moves = moves;
+    for (size_t i = 0; i < blocks.size(); i++)
+        if (blocks[i].live)
+        {
+            s.used += blocks[i].size;
+            s.allocations++;
+        }
+
+    size_t free = 0;
+    for (std::map<size_t, size_t>::const_iterator it = freeByOffset.begin(); it != freeByOffset.end(); ++it)
+    {
+        free += it->second;
+        s.largestFree = std::max(s.largestFree, it->second);
+        s.freeBlocks++;
+    }
+    s.occupancy = capacity ? s.used / (float)capacity : 0.0f;
+    s.fragmentation = free ? 1.0f - s.largestFree / (float)free : 0.0f;
+    return s;
+}
+
+
+GpuMeshHeap::GpuMeshHeap(size_t vertexBytes, size_t indexBytes)
+    : vertexData(vertexBytes), indexData(indexBytes)
+{
+}
+
+GpuMeshHeap::~GpuMeshHeap()
+{
+    for (size_t i = 0; i < formats.size(); i++)
+        if (formats[i].vao)
+            glDeleteVertexArrays(1, &formats[i].vao);
+}
+
+int GpuMeshHeap::addFormat(int stride, GpuVertexLayoutFunc layout)
+{
+    for (size_t i = 0; i < formats.size(); i++)
+        if (formats[i].stride == stride && formats[i].layout == layout)
+            return i;
+
+    Format f = { stride, layout, 0 };
+    formats.push_back(f);
+    return formats.size() - 1;
+}
+
+unsigned int GpuMeshHeap::vao(int format)
+{
+    Format &f = formats[format];
+    if (!f.vao)
+    {
+        glGenVertexArrays(1, &f.vao);
+        cacheBindVertexArray(f.vao);
+        cacheBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexData.buffer());
+        cacheBindBuffer(GL_ARRAY_BUFFER, vertexData.buffer());
+        f.layout();
+    }
+    return f.vao;
+}
+
+GpuMesh GpuMeshHeap::addMesh(int format, const void *vertices, int vertexCount, const unsigned int *indices,
+                             int indexCount)
+{
+    int stride = formats[format].stride;
+
+    // Vertex ranges start at a multiple of the stride, so the mesh is a
+    // whole number of vertices into the shared VAO (its base vertex).
+    GpuMesh m;
+    m.format = format;
+    m.vertexCount = vertexCount;
+    m.indexCount = indexCount;
+    m.vertices = vertexData.allocate((size_t)vertexCount * stride, stride);
+    vertexData.upload(m.vertices, vertices, (size_t)vertexCount * stride);
+    m.indices = indexData.allocate(indexCount * sizeof(unsigned int), sizeof(unsigned int));
+    indexData.upload(m.indices, indices, indexCount * sizeof(unsigned int));
+    return m;
+}
+
+void GpuMeshHeap::removeMesh(const GpuMesh &mesh)
+{
+    vertexData.release(mesh.vertices);
+    indexData.release(mesh.indices);
+}
+
+GLint GpuMeshHeap::baseVertex(const GpuMesh &mesh) const
+{
+    return vertexData.offset(mesh.vertices) / formats[mesh.format].stride;
+}
+
+GLuint GpuMeshHeap::firstIndex(const GpuMesh &mesh) const
+{
+    return indexData.offset(mesh.indices) / sizeof(unsigned int);
+}
+
+void GpuMeshHeap::draw(const GpuMesh &mesh, GLenum mode)
+{
+    cacheBindVertexArray(vao(mesh.format));
+    glDrawElementsBaseVertex(mode, mesh.indexCount, GL_UNSIGNED_INT,
+                             (void *)indexData.offset(mesh.indices), baseVertex(mesh));
+}
+
+bool GpuMeshHeap::defragment()
+{
+    bool moved = vertexData.defragment();
+    moved = indexData.defragment() || moved;
+    return moved;
+}
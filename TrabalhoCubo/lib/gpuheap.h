@@ -0,0 +1,227 @@
+/**
+ * @file gpuheap.h
+ * GPU buffer suballocation.
+ *
+ * A few large GL buffers hold the data of many meshes instead of one
+ * buffer (and one VAO) per mesh. GpuBufferArena hands out ranges of one
+ * buffer from a free list (best fit, coalescing on release); GpuMeshHeap
+ * keeps a vertex and an index arena and one VAO per vertex format, so
+ * every mesh of a format draws from the same VAO with
+ * glDrawElementsBaseVertex. Per-object data does not live here: MultiDraw
+ * streams it through its own texture buffer every frame.
+ *
+ * Arenas grow when full and can be defragmented; both move data inside
+ * the buffer through a scratch copy, so buffer names (and VAOs pointing
+ * at them) stay valid. Offsets may change: keep handles and ask for the
+ * offset when drawing.
+ */
+
+#ifndef GPUHEAP_H
+#define GPUHEAP_H
+
+#include <stddef.h>
+#include <map>
+#include <vector>
+#include <GL/glew.h>
+
+
+/** Occupancy of an arena. */
+struct GpuArenaStats
+{
+    /** Buffer size in bytes. */
+    size_t capacity;
+    /** Bytes in live allocations. */
+    size_t used;
+    /** Largest free block. */
+    size_t largestFree;
+    /** Live allocations. */
+    unsigned int allocations;
+    /** Free blocks. */
+    unsigned int freeBlocks;
+    /** Allocations moved by defragmentation since the start. */
+    unsigned int moves;
+    /** used / capacity. */
+    float occupancy;
+    /** 1 - largestFree / free bytes: 0 when all free space is one block. */
+    float fragmentation;
+};
+
+/**
+ * Ranges of one GL buffer.
+ *
+ * The buffer is created on the first allocation, so arenas can be
+ * declared before the GL context exists.
+ */
+class GpuBufferArena
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param capacity Initial size in bytes.
+     * @param usage Buffer usage hint.
+     */
+    GpuBufferArena(size_t capacity, GLenum usage = GL_STATIC_DRAW);
+    ~GpuBufferArena();
+
+    /**
+     * Allocate a range.
+     *
+     * Grows the buffer when no free block fits.
+     *
+     * @param size Bytes.
+     * @param alignment Offset multiple (any positive value, e.g. a vertex stride).
+     * @return Handle.
+     */
+    int allocate(size_t size, size_t alignment = 4);
+
+    /** Release a range. */
+    void release(int handle);
+
+    /**
+     * Fill part of a range.
+     *
+     * @param handle Range.
+     * @param data Data.
+     * @param bytes Number of bytes.
+     * @param at Byte offset inside the range.
+     */
+    void upload(int handle, const void *data, size_t bytes, size_t at = 0);
+
+    /** Current byte offset of a range. */
+    size_t offset(int handle) const { return blocks[handle].offset; }
+    /** Size of a range. */
+    size_t size(int handle) const { return blocks[handle].size; }
+
+    /** GL buffer (created if needed). */
+    GLuint buffer();
+
+    /**
+     * Move the live ranges down to close the gaps between them.
+     *
+     * @return true if any range moved.
+     */
+    bool defragment();
+
+    /** Occupancy and fragmentation. */
+    GpuArenaStats stats() const;
+
+private:
+    struct Block
+    {
+        size_t offset, size, alignment;
+        bool live;
+    };
+
+    void create();
+    void grow(size_t minimum);
+    void addFree(size_t offset, size_t size);
+    void removeFree(size_t offset, size_t size);
+    void copy(GLuint from, size_t fromOffset, GLuint to, size_t toOffset, size_t bytes);
+
+    GLenum usage;
+    size_t capacity;
+    GLuint name;
+    unsigned int moves;
+
+    std::vector<Block> blocks;
+    std::vector<int> unused;
+    /** Free blocks by offset (to merge neighbours) and by size (best fit). */
+    std::map<size_t, size_t> freeByOffset;
+    std::multimap<size_t, size_t> freeBySize;
+};
+
+/**
+ * Vertex attribute layout of a format.
+ *
+ * Called with the format's VAO and the heap's vertex buffer bound;
+ * declares the attributes with offsets relative to the first vertex.
+ */
+typedef void (*GpuVertexLayoutFunc)(void);
+
+/** A mesh in a GpuMeshHeap. */
+struct GpuMesh
+{
+    int format;
+    int vertices;
+    int indices;
+    int vertexCount;
+    int indexCount;
+};
+
+/**
+ * Vertex and index arenas with one VAO per vertex format.
+ */
+class GpuMeshHeap
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param vertexBytes Initial vertex buffer size.
+     * @param indexBytes Initial index buffer size.
+     */
+    GpuMeshHeap(size_t vertexBytes = 8 << 20, size_t indexBytes = 4 << 20);
+    ~GpuMeshHeap();
+
+    /**
+     * Register a vertex format.
+     *
+     * Formats with the same stride and layout function are the same
+     * format. Needs no GL context (the VAO is created on first use).
+     *
+     * @param stride Bytes per vertex.
+     * @param layout Attribute layout.
+     * @return Format identifier.
+     */
+    int addFormat(int stride, GpuVertexLayoutFunc layout);
+
+    /** Bytes per vertex of a format. */
+    int stride(int format) const { return formats[format].stride; }
+
+    /** Shared VAO of a format (with the index buffer bound). */
+    unsigned int vao(int format);
+
+    /**
+     * Add a mesh.
+     *
+     * @param format Vertex format.
+     * @param vertices Vertex data.
+     * @param vertexCount Number of vertices.
+     * @param indices Triangle list relative to the mesh's first vertex.
+     * @param indexCount Number of indices.
+     * @return Mesh.
+     */
+    GpuMesh addMesh(int format, const void *vertices, int vertexCount, const unsigned int *indices,
+                    int indexCount);
+
+    /** Release a mesh (its ranges become free blocks until reused or defragmented). */
+    void removeMesh(const GpuMesh &mesh);
+
+    /** Index of the mesh's first vertex in its format's VAO. */
+    GLint baseVertex(const GpuMesh &mesh) const;
+    /** Position of the mesh's first index in the index buffer. */
+    GLuint firstIndex(const GpuMesh &mesh) const;
+
+    /** Draw a mesh with its format's VAO. */
+    void draw(const GpuMesh &mesh, GLenum mode = GL_TRIANGLES);
+
+    /** Defragment both arenas; true if anything moved. */
+    bool defragment();
+
+    const GpuBufferArena &vertexArena() const { return vertexData; }
+    const GpuBufferArena &indexArena() const { return indexData; }
+
+private:
+    struct Format
+    {
+        int stride;
+        GpuVertexLayoutFunc layout;
+        unsigned int vao;
+    };
+
+    GpuBufferArena vertexData, indexData;
+    std::vector<Format> formats;
+};
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * @file matbatch.cpp
+ * Batched matrix composition.
+ *
+ * One kernel body written with GCC vector extensions and instantiated for
+ * scalar, SSE (4 lanes) and AVX2 (8 lanes, compiled for that target and
+ * selected at run time). Each lane is one object.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "matbatch.h"
+
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef float v8sf __attribute__((vector_size(32)));
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MATBATCH_X86 1
+#endif
+
+
+/**
+ * Compose one block.
+ *
+ * Rotation R = Ry * Rx * Rz expanded in closed form:
+ *
+ *     | cy*cz + sy*sx*sz   sy*sx*cz - cy*sz   sy*cx |
+ *     | cx*sz              cx*cz              -sx   |
+ *     | cy*sx*sz - sy*cz   sy*sz + cy*sx*cz   cy*cx |
+ *
+ * With uniform scale s the model 3x3 is R*s and the normal matrix R/s.
+ *
+ * @param V Vector type (or float).
+ * @param L Lanes in V.
+ * @param base First object of the block.
+ * @param n Objects in the block (at most L).
+ */
+template <typename V, int L>
+static inline __attribute__((always_inline))
+void composeBlock(int base, int n, const MatBatchInput &in, const float *vp,
+                  const MatBatchOutput &out)
+{
+    float lsx[L], lcx[L], lsy[L], lcy[L], lsz[L], lcz[L];
+    float lpx[L], lpy[L], lpz[L], ls[L];
+
+    const float toRad = 3.14159265358979f / 180.0f;
+    for (int l = 0; l < L; l++)
+    {
+        // Lanes past the end repeat the first object with no rotation; never stored.
+        int i = base + (l < n ? l : 0);
+        float k = l < n ? 1.0f : 0.0f;
+        lsx[l] = sinf(in.ax[i] * toRad * k); lcx[l] = cosf(in.ax[i] * toRad * k);
+        lsy[l] = sinf(in.ay[i] * toRad * k); lcy[l] = cosf(in.ay[i] * toRad * k);
+        lsz[l] = sinf(in.az[i] * toRad * k); lcz[l] = cosf(in.az[i] * toRad * k);
+        lpx[l] = in.px[i];
+        lpy[l] = in.py[i];
+        lpz[l] = in.pz[i];
+        ls[l]  = l < n ? in.scale[i] : 1.0f;
+    }
+
+    V sx, cx, sy, cy, sz, cz, px, py, pz, s;
+    memcpy(&sx, lsx, sizeof(V)); memcpy(&cx, lcx, sizeof(V));
+    memcpy(&sy, lsy, sizeof(V)); memcpy(&cy, lcy, sizeof(V));
+    memcpy(&sz, lsz, sizeof(V)); memcpy(&cz, lcz, sizeof(V));
+    memcpy(&px, lpx, sizeof(V)); memcpy(&py, lpy, sizeof(V));
+    memcpy(&pz, lpz, sizeof(V)); memcpy(&s, ls, sizeof(V));
+
+    V sysx = sy * sx, cysx = cy * sx;
+    V r00 = cy * cz + sysx * sz, r01 = sysx * cz - cy * sz, r02 = sy * cx;
+    V r10 = cx * sz,             r11 = cx * cz,             r12 = -sx;
+    V r20 = cysx * sz - sy * cz, r21 = sy * sz + cysx * cz, r22 = cy * cx;
+
+    // Column major model matrix; the w row is (0, 0, 0, 1).
+    V m[16];
+    V zero = s - s, one = zero + 1.0f;
+    m[0]  = r00 * s; m[1]  = r10 * s; m[2]  = r20 * s; m[3]  = zero;
+    m[4]  = r01 * s; m[5]  = r11 * s; m[6]  = r21 * s; m[7]  = zero;
+    m[8]  = r02 * s; m[9]  = r12 * s; m[10] = r22 * s; m[11] = zero;
+    m[12] = px;      m[13] = py;      m[14] = pz;      m[15] = one;
+
+    float tmp[16][L];
+
+    if (out.model)
+    {
+        memcpy(tmp, m, sizeof(m));
+        for (int l = 0; l < n; l++)
+            for (int e = 0; e < 16; e++)
+                out.model[(size_t)(base + l) * 16 + e] = tmp[e][l];
+    }
+
+    if (out.normal)
+    {
+        V inv = one / s;
+        V nm[9] = { r00 * inv, r10 * inv, r20 * inv,
+                    r01 * inv, r11 * inv, r21 * inv,
+                    r02 * inv, r12 * inv, r22 * inv };
+        memcpy(tmp, nm, sizeof(nm));
+        for (int l = 0; l < n; l++)
+            for (int e = 0; e < 9; e++)
+                out.normal[(size_t)(base + l) * 9 + e] = tmp[e][l];
+    }
+
+    if (out.mvp)
+    {
+        // vp is shared by all lanes: each term is a broadcast times a lane vector.
+        V c[16];
+        for (int j = 0; j < 3; j++)
+            for (int r = 0; r < 4; r++)
+                c[j * 4 + r] = vp[r] * m[j * 4] + vp[4 + r] * m[j * 4 + 1] + vp[8 + r] * m[j * 4 + 2];
+        for (int r = 0; r < 4; r++)
+            c[12 + r] = vp[r] * px + vp[4 + r] * py + vp[8 + r] * pz + vp[12 + r];
+
+        memcpy(tmp, c, sizeof(c));
+        for (int l = 0; l < n; l++)
+            for (int e = 0; e < 16; e++)
+                out.mvp[(size_t)(base + l) * 16 + e] = tmp[e][l];
+    }
+}
+
+template <typename V, int L>
+static inline __attribute__((always_inline))
+void composeAll(int count, const MatBatchInput &in, const float *vp, const MatBatchOutput &out)
+{
+    for (int base = 0; base < count; base += L)
+        composeBlock<V, L>(base, count - base < L ? count - base : L, in, vp, out);
+}
+
+static void composeScalar(int count, const MatBatchInput &in, const float *vp, const MatBatchOutput &out)
+{
+    composeAll<float, 1>(count, in, vp, out);
+}
+
+static void composeSSE(int count, const MatBatchInput &in, const float *vp, const MatBatchOutput &out)
+{
+    composeAll<v4sf, 4>(count, in, vp, out);
+}
+
+#ifdef MATBATCH_X86
+__attribute__((target("avx2,fma")))
+static void composeAVX2(int count, const MatBatchInput &in, const float *vp, const MatBatchOutput &out)
+{
+    composeAll<v8sf, 8>(count, in, vp, out);
+}
+#endif
+
+/** Kernel MATBATCH_AUTO resolves to. */
+static MatBatchKernel bestKernel()
+{
+    static MatBatchKernel best = MATBATCH_AUTO;
+    if (best == MATBATCH_AUTO)
+    {
+#ifdef MATBATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            best = MATBATCH_AVX2;
+        else
+            best = MATBATCH_SSE;
+#else
+        best = MATBATCH_SSE;
+#endif
+    }
+    return best;
+}
+
+void matComposeBatch(int count, const MatBatchInput &in, const float *viewProj,
+                     const MatBatchOutput &out, MatBatchKernel kernel)
+{
+    if (kernel == MATBATCH_AUTO)
+        kernel = bestKernel();
+
+    switch (kernel)
+    {
+#ifdef MATBATCH_X86
+        case MATBATCH_AVX2:
+            if (bestKernel() == MATBATCH_AVX2)
+            {
+                composeAVX2(count, in, viewProj, out);
+                break;
+            }
+            // Not supported here: use SSE.
+            composeSSE(count, in, viewProj, out);
+            break;
+#endif
+        case MATBATCH_SSE:
+            composeSSE(count, in, viewProj, out);
+            break;
+        default:
+            composeScalar(count, in, viewProj, out);
+            break;
+    }
+}
+
+const char *matBatchKernelName(MatBatchKernel kernel)
+{
+    if (kernel == MATBATCH_AUTO)
+        kernel = bestKernel();
+    switch (kernel)
+    {
+        case MATBATCH_AVX2: return "AVX2";
+        case MATBATCH_SSE:  return "SSE";
+        default:            return "scalar";
+    }
+}
+
+float matBatchVerify(int count)
+{
+    std::vector<float> px(count), py(count), pz(count), ax(count), ay(count), az(count), sc(count);
+    for (int i = 0; i < count; i++)
+    {
+        px[i] = rand() / (float)RAND_MAX * 4.0f - 2.0f;
+        py[i] = rand() / (float)RAND_MAX * 4.0f - 2.0f;
+        pz[i] = rand() / (float)RAND_MAX * 4.0f - 2.0f;
+        ax[i] = rand() / (float)RAND_MAX * 360.0f;
+        ay[i] = rand() / (float)RAND_MAX * 360.0f;
+        az[i] = rand() / (float)RAND_MAX * 360.0f;
+        sc[i] = 0.05f + rand() / (float)RAND_MAX * 2.0f;
+    }
+    MatBatchInput in = { px.data(), py.data(), pz.data(), ax.data(), ay.data(), az.data(), sc.data() };
+
+    glm::mat4 vp = glm::perspective(glm::radians(52.0f), 4.0f / 3.0f, 0.1f, 100.0f)
+                 * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
+
+    // Reference: one object at a time, the way the cube program does it.
+    std::vector<float> refModel(count * 16), refNormal(count * 9), refMVP(count * 16);
+    for (int i = 0; i < count; i++)
+    {
+        glm::mat4 S  = glm::scale(glm::mat4(1.0f), glm::vec3(sc[i]));
+        glm::mat4 Rx = glm::rotate(glm::mat4(1.0f), glm::radians(ax[i]), glm::vec3(1.0f, 0.0f, 0.0f));
+        glm::mat4 Ry = glm::rotate(glm::mat4(1.0f), glm::radians(ay[i]), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 Rz = glm::rotate(glm::mat4(1.0f), glm::radians(az[i]), glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat4 T  = glm::translate(glm::mat4(1.0f), glm::vec3(px[i], py[i], pz[i]));
+        glm::mat4 model = T * Ry * Rx * Rz * S;
+        glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(model)));
+        glm::mat4 mvp = vp * model;
+        memcpy(&refModel[i * 16], glm::value_ptr(model), 16 * sizeof(float));
+        memcpy(&refNormal[i * 9], glm::value_ptr(normal), 9 * sizeof(float));
+        memcpy(&refMVP[i * 16], glm::value_ptr(mvp), 16 * sizeof(float));
+    }
+
+    std::vector<float> model(count * 16), normal(count * 9), mvp(count * 16);
+    MatBatchOutput out = { model.data(), normal.data(), mvp.data() };
+
+    float worst = 0.0f;
+    MatBatchKernel kernels[3] = { MATBATCH_SCALAR, MATBATCH_SSE, MATBATCH_AVX2 };
+    for (int k = 0; k < 3; k++)
+    {
+        if (kernels[k] == MATBATCH_AVX2 && bestKernel() != MATBATCH_AVX2)
+            continue;
+        matComposeBatch(count, in, glm::value_ptr(vp), out, kernels[k]);
+        for (int i = 0; i < count * 16; i++)
+        {
+            worst = fmaxf(worst, fabsf(model[i] - refModel[i]));
+            worst = fmaxf(worst, fabsf(mvp[i] - refMVP[i]));
+        }
+        for (int i = 0; i < count * 9; i++)
+            worst = fmaxf(worst, fabsf(normal[i] - refNormal[i]));
+    }
+    return worst;
+}
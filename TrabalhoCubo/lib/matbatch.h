@@ -0,0 +1,81 @@
+/**
+ * @file matbatch.h
+ * Batched matrix composition.
+ *
+ * Builds model, normal and MVP matrices for many objects at once from
+ * position, Euler angles and uniform scale, several objects per SIMD
+ * register. Inputs are structure of arrays; outputs are column major
+ * matrices, one after the other, as glUniformMatrix*fv and instanced
+ * attributes expect.
+ *
+ * The model matrix is T * Ry * Rx * Rz * S, as in the cube program.
+ */
+
+#ifndef MATBATCH_H
+#define MATBATCH_H
+
+
+/** Input of matComposeBatch (structure of arrays, count entries each). */
+struct MatBatchInput
+{
+    /** Positions. */
+    const float *px, *py, *pz;
+    /** Rotation angles around x, y and z, in degrees. */
+    const float *ax, *ay, *az;
+    /** Uniform scale. */
+    const float *scale;
+};
+
+/** Output of matComposeBatch (any pointer may be NULL to skip it). */
+struct MatBatchOutput
+{
+    /** Model matrices, 16 floats each. */
+    float *model;
+    /** Normal matrices (inverse transpose of the model 3x3), 9 floats each. */
+    float *normal;
+    /** Projection * view * model, 16 floats each. */
+    float *mvp;
+};
+
+/** Kernels. */
+enum MatBatchKernel
+{
+    /** Best kernel supported by the CPU. */
+    MATBATCH_AUTO,
+    MATBATCH_SCALAR,
+    MATBATCH_SSE,
+    MATBATCH_AVX2
+};
+
+/**
+ * Compose matrices.
+ *
+ * @param count Number of objects.
+ * @param in Input arrays.
+ * @param viewProj Projection * view (16 floats, column major).
+ * @param out Output arrays.
+ * @param kernel Kernel to use.
+ */
+void matComposeBatch(int count, const MatBatchInput &in, const float *viewProj,
+                     const MatBatchOutput &out, MatBatchKernel kernel = MATBATCH_AUTO);
+
+/**
+ * Kernel name.
+ *
+ * @param kernel Kernel (MATBATCH_AUTO resolves to the selected one).
+ * @return Printable name.
+ */
+const char *matBatchKernelName(MatBatchKernel kernel);
+
+/**
+ * Verify kernels.
+ *
+ * Composes random inputs with every kernel the CPU supports and compares
+ * them with the same matrices built one at a time with glm.
+ *
+ * @param count Number of objects to test.
+ * @return Largest absolute difference found.
+ */
+float matBatchVerify(int count);
+
+#endif
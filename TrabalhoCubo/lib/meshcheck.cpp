@@ -0,0 +1,378 @@
+/**
+ * @file meshcheck.cpp
+ * Mesh validation.
+ *
+ * Implements the edge analysis and the winding repair.
+ */
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "meshcheck.h"
+
+
+/** Use of an edge by a triangle. */
+struct MeshEdge
+{
+    /** Welded end points, lo < hi. */
+    unsigned int lo, hi;
+    /** Triangle and its corner where the edge starts. */
+    int triangle, corner;
+    /** The triangle runs along the edge from lo to hi. */
+    bool forward;
+
+    bool operator<(const MeshEdge &o) const
+    {
+        return lo != o.lo ? lo < o.lo : hi < o.hi;
+    }
+};
+
+/** Connectivity found by analyzeMesh(). */
+struct MeshTopology
+{
+    /** Triangle across each edge (three per triangle); -1 when the edge is not shared by exactly two. */
+    std::vector<int> neighbour;
+    /** The neighbour runs along the shared edge in the same direction. */
+    std::vector<unsigned char> same;
+    /** Triangle has a boundary or non-manifold edge. */
+    std::vector<unsigned char> open;
+    /** Degenerate or duplicate triangle, left out of the edges. */
+    std::vector<unsigned char> removable;
+};
+
+
+/**
+ * Weld vertices by position.
+ *
+ * Positions are snapped to a grid of the welding distance; vertices in the
+ * same cell get the id of the first of them.
+ */
+static std::vector<unsigned int> weldVertices(const float *positions, int stride, int vertexCount, float weld)
+{
+    struct Cell
+    {
+        long long x, y, z;
+        unsigned int vertex;
+
+        bool operator<(const Cell &o) const
+        {
+            if (x != o.x) return x < o.x;
+            if (y != o.y) return y < o.y;
+            if (z != o.z) return z < o.z;
+            return vertex < o.vertex;
+        }
+    };
+
+    std::vector<Cell> cells(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+    {
+        const float *p = positions + v * stride;
+        cells[v].x = llroundf(p[0] / weld);
+        cells[v].y = llroundf(p[1] / weld);
+        cells[v].z = llroundf(p[2] / weld);
+        cells[v].vertex = v;
+    }
+    std::sort(cells.begin(), cells.end());
+
+    std::vector<unsigned int> id(vertexCount);
+    for (int i = 0; i < vertexCount; i++)
+    {
+        bool first = i == 0 || cells[i].x != cells[i - 1].x || cells[i].y != cells[i - 1].y ||
+                     cells[i].z != cells[i - 1].z;
+        id[cells[i].vertex] = first ? cells[i].vertex : id[cells[i - 1].vertex];
+    }
+    return id;
+}
+
+/** Unnormalized face normal of a triangle. */
+static void faceNormal(const float *positions, int stride, const unsigned int *tri, float *n)
+{
+    const float *a = positions + tri[0] * stride;
+    const float *b = positions + tri[1] * stride;
+    const float *c = positions + tri[2] * stride;
+    float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+/** Face normal dotted with the sum of the vertex normals. */
+static float normalAgreement(const float *positions, const float *normals, int stride, const unsigned int *tri)
+{
+    float n[3];
+    faceNormal(positions, stride, tri, n);
+
+    float d = 0.0f;
+    for (int k = 0; k < 3; k++)
+    {
+        const float *vn = normals + tri[k] * stride;
+        d += n[0] * vn[0] + n[1] * vn[1] + n[2] * vn[2];
+    }
+    return d;
+}
+
+/** Edge analysis shared by checkMesh() and repairMesh(). */
+static MeshCheckReport analyzeMesh(const unsigned int *indices, int indexCount, const float *positions,
+                                   int stride, int vertexCount, const float *normals, float weld,
+                                   MeshTopology &topology)
+{
+    MeshCheckReport report = {};
+    int triangleCount = indexCount / 3;
+    report.triangles = triangleCount;
+
+    std::vector<unsigned int> id = weldVertices(positions, stride, vertexCount, weld);
+
+    topology.neighbour.assign(3 * triangleCount, -1);
+    topology.same.assign(3 * triangleCount, 0);
+    topology.open.assign(triangleCount, 0);
+    topology.removable.assign(triangleCount, 0);
+
+    // Degenerate triangles, then duplicates (same welded corners in any order).
+    struct Corners
+    {
+        unsigned int w[3];
+        int triangle;
+
+        bool operator<(const Corners &o) const
+        {
+            if (w[0] != o.w[0]) return w[0] < o.w[0];
+            if (w[1] != o.w[1]) return w[1] < o.w[1];
+            if (w[2] != o.w[2]) return w[2] < o.w[2];
+            return triangle < o.triangle;
+        }
+    };
+
+    std::vector<Corners> corners;
+    corners.reserve(triangleCount);
+    for (int t = 0; t < triangleCount; t++)
+    {
+        const unsigned int *tri = indices + 3 * t;
+        Corners c = {{id[tri[0]], id[tri[1]], id[tri[2]]}, t};
+        float n[3];
+        faceNormal(positions, stride, tri, n);
+
+        if (c.w[0] == c.w[1] || c.w[1] == c.w[2] || c.w[2] == c.w[0] ||
+            n[0] * n[0] + n[1] * n[1] + n[2] * n[2] <= weld * weld * weld * weld)
+        {
+            topology.removable[t] = 1;
+            report.degenerate++;
+            continue;
+        }
+
+        std::sort(c.w, c.w + 3);
+        corners.push_back(c);
+    }
+
+    // The first of equal triangles is kept.
+    std::sort(corners.begin(), corners.end());
+    for (size_t i = 1; i < corners.size(); i++)
+    {
+        if (corners[i].w[0] == corners[i - 1].w[0] && corners[i].w[1] == corners[i - 1].w[1] &&
+            corners[i].w[2] == corners[i - 1].w[2])
+        {
+            topology.removable[corners[i].triangle] = 1;
+            report.duplicate++;
+        }
+    }
+
+    // Edges of the remaining triangles, grouped by their end points.
+    std::vector<MeshEdge> edges;
+    edges.reserve(indexCount);
+    for (int t = 0; t < triangleCount; t++)
+    {
+        if (topology.removable[t])
+            continue;
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = id[indices[3 * t + k]], b = id[indices[3 * t + (k + 1) % 3]];
+            MeshEdge e;
+            e.lo = std::min(a, b);
+            e.hi = std::max(a, b);
+            e.triangle = t;
+            e.corner = k;
+            e.forward = a < b;
+            edges.push_back(e);
+        }
+
+        if (normals && normalAgreement(positions, normals, stride, indices + 3 * t) < 0.0f)
+            report.normalMismatches++;
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j].lo == edges[i].lo && edges[j].hi == edges[i].hi)
+            j++;
+
+        if (j - i == 2)
+        {
+            const MeshEdge &a = edges[i], &b = edges[i + 1];
+            bool same = a.forward == b.forward;
+            topology.neighbour[3 * a.triangle + a.corner] = b.triangle;
+            topology.neighbour[3 * b.triangle + b.corner] = a.triangle;
+            topology.same[3 * a.triangle + a.corner] = same;
+            topology.same[3 * b.triangle + b.corner] = same;
+            if (same)
+                report.inconsistentEdges++;
+        }
+        else
+        {
+            if (j - i == 1)
+                report.boundaryEdges++;
+            else
+                report.nonManifoldEdges++;
+            for (size_t k = i; k < j; k++)
+                topology.open[edges[k].triangle] = 1;
+        }
+        i = j;
+    }
+
+    // Connected pieces.
+    std::vector<unsigned char> seen(triangleCount, 0);
+    std::vector<int> stack;
+    for (int t = 0; t < triangleCount; t++)
+    {
+        if (seen[t] || topology.removable[t])
+            continue;
+
+        report.components++;
+        seen[t] = 1;
+        stack.push_back(t);
+        while (!stack.empty())
+        {
+            int c = stack.back();
+            stack.pop_back();
+            for (int k = 0; k < 3; k++)
+            {
+                int n = topology.neighbour[3 * c + k];
+                if (n >= 0 && !seen[n])
+                {
+                    seen[n] = 1;
+                    stack.push_back(n);
+                }
+            }
+        }
+    }
+
+    report.closed = triangleCount > report.degenerate + report.duplicate && report.boundaryEdges == 0 &&
+                    report.nonManifoldEdges == 0 && report.inconsistentEdges == 0;
+    return report;
+}
+
+MeshCheckReport checkMesh(const unsigned int *indices, int indexCount, const float *positions, int stride,
+                          int vertexCount, const float *normals, float weld)
+{
+    MeshTopology topology;
+    return analyzeMesh(indices, indexCount, positions, stride, vertexCount, normals, weld, topology);
+}
+
+MeshCheckReport repairMesh(unsigned int *indices, int &indexCount, const float *positions, int stride,
+                           int vertexCount, const float *normals, float weld)
+{
+    MeshTopology topology;
+    MeshCheckReport report = analyzeMesh(indices, indexCount, positions, stride, vertexCount, normals, weld,
+                                         topology);
+
+    // Drop degenerate and duplicate triangles; they only add ambiguous edges.
+    int removed = report.degenerate + report.duplicate;
+    if (removed)
+    {
+        int kept = 0;
+        for (int t = 0; t < indexCount / 3; t++)
+        {
+            if (topology.removable[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+                indices[3 * kept + k] = indices[3 * t + k];
+            kept++;
+        }
+        indexCount = 3 * kept;
+        report = analyzeMesh(indices, indexCount, positions, stride, vertexCount, normals, weld, topology);
+    }
+
+    // Spread the orientation of a seed triangle over its piece through the
+    // manifold edges: a neighbour running along the shared edge in the same
+    // direction must be flipped relative to the current triangle. On a
+    // non-orientable piece the first orientation reached wins.
+    int triangleCount = indexCount / 3;
+    std::vector<unsigned char> flip(triangleCount, 0), seen(triangleCount, 0);
+    std::vector<int> piece;
+    int flipped = 0;
+
+    for (int seed = 0; seed < triangleCount; seed++)
+    {
+        if (seen[seed])
+            continue;
+
+        piece.clear();
+        piece.push_back(seed);
+        seen[seed] = 1;
+        for (size_t i = 0; i < piece.size(); i++)
+        {
+            int c = piece[i];
+            for (int k = 0; k < 3; k++)
+            {
+                int n = topology.neighbour[3 * c + k];
+                if (n >= 0 && !seen[n])
+                {
+                    seen[n] = 1;
+                    flip[n] = flip[c] ^ topology.same[3 * c + k];
+                    piece.push_back(n);
+                }
+            }
+        }
+
+        // Turn the whole piece outwards.
+        bool closed = true;
+        int changed = 0;
+        for (size_t i = 0; i < piece.size(); i++)
+        {
+            closed = closed && !topology.open[piece[i]];
+            changed += flip[piece[i]];
+        }
+
+        double sum = 0.0;
+        if (closed)
+        {
+            // Six times the signed volume: positive when counter-clockwise seen from outside.
+            for (size_t i = 0; i < piece.size(); i++)
+            {
+                const unsigned int *tri = indices + 3 * piece[i];
+                const float *a = positions + tri[0] * stride;
+                float n[3];
+                faceNormal(positions, stride, tri, n);
+                double v = a[0] * n[0] + a[1] * n[1] + a[2] * n[2];
+                sum += flip[piece[i]] ? -v : v;
+            }
+        }
+        else if (normals)
+        {
+            for (size_t i = 0; i < piece.size(); i++)
+            {
+                float d = normalAgreement(positions, normals, stride, indices + 3 * piece[i]);
+                sum += flip[piece[i]] ? -d : d;
+            }
+        }
+        else
+            sum = piece.size() - 2.0 * changed;
+
+        bool invert = sum < 0.0;
+        for (size_t i = 0; i < piece.size(); i++)
+        {
+            int t = piece[i];
+            if (flip[t] != invert)
+            {
+                std::swap(indices[3 * t + 1], indices[3 * t + 2]);
+                flipped++;
+            }
+        }
+    }
+
+    report = checkMesh(indices, indexCount, positions, stride, vertexCount, normals, weld);
+    report.removed = removed;
+    report.flipped = flipped;
+    return report;
+}
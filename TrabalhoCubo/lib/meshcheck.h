@@ -0,0 +1,98 @@
+/**
+ * @file meshcheck.h
+ * Mesh validation.
+ *
+ * Checks an indexed triangle list before it is drawn with back-face
+ * culling. A closed mesh (every edge shared by exactly two triangles that
+ * run along it in opposite directions) that is wound counter-clockwise
+ * seen from outside can be drawn with GL_CULL_FACE, which skips about half
+ * of its triangles before rasterization. A single miswound triangle then
+ * shows up as a hole, so the checks below find:
+ *
+ * - degenerate triangles (repeated vertex or zero area);
+ * - boundary edges (one triangle) and non-manifold edges (three or more);
+ * - inconsistent winding (two triangles running along an edge in the same
+ *   direction);
+ * - normal/winding disagreement (face normal opposite to the vertex
+ *   normals).
+ *
+ * Vertices are welded by position first, so faces with their own vertices
+ * (hard edges, texture seams) still count as connected.
+ */
+
+#ifndef MESHCHECK_H
+#define MESHCHECK_H
+
+#include <stddef.h>
+
+
+/** Default distance under which two positions are the same vertex. */
+#define MESHCHECK_WELD 1e-5f
+
+/** Result of checkMesh() and repairMesh(). */
+struct MeshCheckReport
+{
+    /** Triangles checked. */
+    int triangles;
+    /** Triangles with a repeated vertex or zero area. */
+    int degenerate;
+    /** Triangles with the same vertices as an earlier one. */
+    int duplicate;
+    /** Edges used by a single triangle. */
+    int boundaryEdges;
+    /** Edges used by three or more triangles. */
+    int nonManifoldEdges;
+    /** Edges whose two triangles run along them in the same direction. */
+    int inconsistentEdges;
+    /** Triangles whose face normal points away from their vertex normals. */
+    int normalMismatches;
+    /** Edge connected pieces. */
+    int components;
+    /** Triangles removed by repairMesh() (degenerate or duplicate). */
+    int removed;
+    /** Triangles flipped by repairMesh(). */
+    int flipped;
+    /** Closed, manifold and consistently wound: safe to cull back faces. */
+    bool closed;
+};
+
+/**
+ * Validate a mesh.
+ *
+ * @param indices Triangle list.
+ * @param indexCount Number of indices.
+ * @param positions First vertex position (x, y, z).
+ * @param stride Floats between consecutive vertices.
+ * @param vertexCount Number of vertices.
+ * @param normals First vertex normal with the same stride, or NULL.
+ * @param weld Welding distance.
+ * @return Problems found.
+ */
+MeshCheckReport checkMesh(const unsigned int *indices, int indexCount, const float *positions, int stride,
+                          int vertexCount, const float *normals = NULL, float weld = MESHCHECK_WELD);
+
+/**
+ * Repair a mesh.
+ *
+ * Removes degenerate and duplicate triangles, then makes the winding
+ * consistent across each connected piece by flipping triangles. Each
+ * piece is finally turned counter-clockwise seen from outside: by its
+ * signed volume when it is closed, by its vertex normals otherwise, and
+ * when neither is available by keeping the orientation most of its
+ * triangles already had. Non-manifold edges cannot be fixed by reordering
+ * indices; orientation is not propagated across them and they stay in the
+ * report.
+ *
+ * @param indices Triangle list (repaired in place).
+ * @param indexCount Number of indices; updated when triangles are removed.
+ * @param positions First vertex position (x, y, z).
+ * @param stride Floats between consecutive vertices.
+ * @param vertexCount Number of vertices.
+ * @param normals First vertex normal with the same stride, or NULL.
+ * @param weld Welding distance.
+ * @return Check of the repaired mesh, with the removed and flipped counts.
+ */
+MeshCheckReport repairMesh(unsigned int *indices, int &indexCount, const float *positions, int stride,
+                           int vertexCount, const float *normals = NULL, float weld = MESHCHECK_WELD);
+
+#endif
@@ -0,0 +1,382 @@
+/**
+ * @file meshgen.h
+ * Compile-time mesh generator.
+ *
+ * Header-only generators of cubes, spheres, tori and grids, evaluated by the
+ * compiler: declared constexpr, the vertex and index arrays are baked into
+ * the binary with no runtime construction. Tessellation is a template
+ * parameter and the vertex format is any type V with
+ *
+ *     static constexpr V make(const MeshAttributes &a);
+ *
+ * so a program picks exactly the attributes (and their order) its shader
+ * reads. Triangles are counter-clockwise seen from outside. The sphere
+ * also has a run-time overload, for tessellations too large to bake.
+ *
+ * Example:
+ *
+ *     constexpr auto sphere = meshSphere<VertexPN, 32, 16>();
+ *     glBufferData(GL_ARRAY_BUFFER, sizeof(sphere.vertices), sphere.vertices.data(), GL_STATIC_DRAW);
+ *     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(sphere.indices), sphere.indices.data(), GL_STATIC_DRAW);
+ *     glDrawElements(GL_TRIANGLES, sphere.indices.size(), GL_UNSIGNED_INT, 0);
+ */
+
+#ifndef MESHGEN_H
+#define MESHGEN_H
+
+#include <array>
+#include <vector>
+#include <stddef.h>
+
+
+/** Attributes of a generated vertex, converted by the vertex format. */
+struct MeshAttributes
+{
+    /** Position. */
+    float position[3];
+    /** Unit normal. */
+    float normal[3];
+    /** Texture coordinates, from 0 to 1 along the tessellation. */
+    float uv[2];
+};
+
+/** Position only. */
+struct VertexP
+{
+    float position[3];
+
+    static constexpr VertexP make(const MeshAttributes &a)
+    {
+        VertexP v{};
+        for (int i = 0; i < 3; i++)
+            v.position[i] = a.position[i];
+        return v;
+    }
+};
+
+/** Position and normal. */
+struct VertexPN
+{
+    float position[3];
+    float normal[3];
+
+    static constexpr VertexPN make(const MeshAttributes &a)
+    {
+        VertexPN v{};
+        for (int i = 0; i < 3; i++)
+        {
+            v.position[i] = a.position[i];
+            v.normal[i] = a.normal[i];
+        }
+        return v;
+    }
+};
+
+/** Position, normal and texture coordinates. */
+struct VertexPNT
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+
+    static constexpr VertexPNT make(const MeshAttributes &a)
+    {
+        VertexPNT v{};
+        for (int i = 0; i < 3; i++)
+        {
+            v.position[i] = a.position[i];
+            v.normal[i] = a.normal[i];
+        }
+        v.uv[0] = a.uv[0];
+        v.uv[1] = a.uv[1];
+        return v;
+    }
+};
+
+/**
+ * Indexed triangle mesh.
+ *
+ * @tparam V Vertex format.
+ * @tparam VertexCount Number of vertices.
+ * @tparam IndexCount Number of indices (three per triangle).
+ */
+template <class V, int VertexCount, int IndexCount>
+struct Mesh
+{
+    std::array<V, VertexCount> vertices;
+    std::array<unsigned int, IndexCount> indices;
+};
+
+
+/** Pi, for the generators. */
+constexpr double MESH_PI = 3.14159265358979323846;
+
+/**
+ * Sine usable in constant expressions.
+ *
+ * Reduces the angle to [-pi, pi] and sums the Taylor series, accurate to
+ * double rounding there.
+ */
+constexpr double meshSin(double x)
+{
+    long k = (long)(x / (2.0 * MESH_PI) + (x >= 0.0 ? 0.5 : -0.5));
+    x -= k * 2.0 * MESH_PI;
+
+    double term = x, sum = x;
+    for (int n = 1; n < 12; n++)
+    {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+/** Cosine usable in constant expressions. */
+constexpr double meshCos(double x)
+{
+    return meshSin(x + 0.5 * MESH_PI);
+}
+
+/** Builds the attributes of one vertex. */
+constexpr MeshAttributes meshAttributes(double px, double py, double pz,
+                                        double nx, double ny, double nz, double u, double v)
+{
+    MeshAttributes a{};
+    a.position[0] = (float)px;
+    a.position[1] = (float)py;
+    a.position[2] = (float)pz;
+    a.normal[0] = (float)nx;
+    a.normal[1] = (float)ny;
+    a.normal[2] = (float)nz;
+    a.uv[0] = (float)u;
+    a.uv[1] = (float)v;
+    return a;
+}
+
+/**
+ * Indices of a regular grid of quads.
+ *
+ * Vertex (i, j) is at first + j * (columns + 1) + i; each quad becomes two
+ * triangles counter-clockwise in (i, j).
+ *
+ * @return Position after the last index written.
+ */
+template <size_t N>
+constexpr int meshGridIndices(std::array<unsigned int, N> &indices, int at, unsigned int first,
+                              int columns, int rows)
+{
+    for (int j = 0; j < rows; j++)
+        for (int i = 0; i < columns; i++)
+        {
+            unsigned int a = first + j * (columns + 1) + i;
+            unsigned int b = a + 1;
+            unsigned int d = a + columns + 1;
+            unsigned int c = d + 1;
+            indices[at++] = a; indices[at++] = b; indices[at++] = c;
+            indices[at++] = a; indices[at++] = c; indices[at++] = d;
+        }
+    return at;
+}
+
+
+/**
+ * Unit cube centered at the origin.
+ *
+ * Each face has its own vertices (flat normals) and is split into
+ * Divisions x Divisions quads.
+ *
+ * @tparam V Vertex format.
+ * @tparam Divisions Quads along each face edge.
+ */
+template <class V, int Divisions = 1>
+constexpr Mesh<V, 6 * (Divisions + 1) * (Divisions + 1), 36 * Divisions * Divisions> meshCube()
+{
+    Mesh<V, 6 * (Divisions + 1) * (Divisions + 1), 36 * Divisions * Divisions> mesh{};
+    int vertex = 0, index = 0;
+
+    // Faces +x, -x, +y, -y, +z, -z; the tangents u, v satisfy u x v = n.
+    for (int face = 0; face < 6; face++)
+    {
+        int axis = face / 2;
+        double s = face % 2 == 0 ? 1.0 : -1.0;
+        double n[3] = {}, u[3] = {}, v[3] = {};
+        n[axis] = s;
+        u[(axis + 1) % 3] = s;
+        v[(axis + 2) % 3] = 1.0;
+
+        index = meshGridIndices(mesh.indices, index, vertex, Divisions, Divisions);
+        for (int j = 0; j <= Divisions; j++)
+            for (int i = 0; i <= Divisions; i++)
+            {
+                double a = 2.0 * i / Divisions - 1.0;
+                double b = 2.0 * j / Divisions - 1.0;
+                double p[3] = {};
+                for (int k = 0; k < 3; k++)
+                    p[k] = 0.5 * (n[k] + a * u[k] + b * v[k]);
+                mesh.vertices[vertex++] = V::make(meshAttributes(p[0], p[1], p[2], n[0], n[1], n[2],
+                                                                 (double)i / Divisions, (double)j / Divisions));
+            }
+    }
+    return mesh;
+}
+
+/**
+ * Vertices and indices of a UV sphere, written to any indexable storage.
+ *
+ * Shared by the compile-time and the run-time meshSphere(); see the former.
+ *
+ * @return Number of indices written.
+ */
+template <class V, class Vertices, class Indices>
+constexpr int meshSphereInto(int slices, int stacks, Vertices &vertices, Indices &indices)
+{
+    int vertex = 0, index = 0;
+
+    for (int j = 0; j <= stacks; j++)
+    {
+        double phi = MESH_PI * j / stacks;
+        for (int i = 0; i <= slices; i++)
+        {
+            double theta = 2.0 * MESH_PI * i / slices;
+            double nx = meshSin(phi) * meshCos(theta);
+            double ny = meshCos(phi);
+            double nz = meshSin(phi) * meshSin(theta);
+            vertices[vertex++] = V::make(meshAttributes(0.5 * nx, 0.5 * ny, 0.5 * nz, nx, ny, nz,
+                                                        (double)i / slices, (double)j / stacks));
+        }
+    }
+
+    for (int j = 0; j < stacks; j++)
+        for (int i = 0; i < slices; i++)
+        {
+            unsigned int a = j * (slices + 1) + i;
+            unsigned int b = a + 1;
+            unsigned int d = a + slices + 1;
+            unsigned int c = d + 1;
+            if (j != 0)
+            {
+                indices[index++] = a; indices[index++] = b; indices[index++] = c;
+            }
+            if (j != stacks - 1)
+            {
+                indices[index++] = a; indices[index++] = c; indices[index++] = d;
+            }
+        }
+    return index;
+}
+
+/**
+ * UV sphere of radius 0.5 centered at the origin.
+ *
+ * Longitude goes around y and latitude from the +y pole down. The seam
+ * column is duplicated for texture coordinates; the pole rows emit one
+ * triangle per slice, so there are no degenerate triangles.
+ *
+ * @tparam V Vertex format.
+ * @tparam Slices Divisions around y (at least 3).
+ * @tparam Stacks Divisions from pole to pole (at least 2).
+ */
+template <class V, int Slices, int Stacks>
+constexpr Mesh<V, (Slices + 1) * (Stacks + 1), 6 * Slices * (Stacks - 1)> meshSphere()
+{
+    static_assert(Slices >= 3 && Stacks >= 2, "sphere needs at least 3 slices and 2 stacks");
+
+    Mesh<V, (Slices + 1) * (Stacks + 1), 6 * Slices * (Stacks - 1)> mesh{};
+    meshSphereInto<V>(Slices, Stacks, mesh.vertices, mesh.indices);
+    return mesh;
+}
+
+/**
+ * UV sphere with the tessellation given at run time.
+ *
+ * Same mesh as meshSphere<V, slices, stacks>(), but built into heap
+ * vectors when called, for meshes too large to bake into the binary.
+ *
+ * @param slices Divisions around y (at least 3).
+ * @param stacks Divisions from pole to pole (at least 2).
+ * @param vertices Replaced by the vertices.
+ * @param indices Replaced by the indices.
+ */
+template <class V>
+void meshSphere(int slices, int stacks, std::vector<V> &vertices, std::vector<unsigned int> &indices)
+{
+    vertices.assign((slices + 1) * (stacks + 1), V());
+    indices.assign(6 * slices * (stacks - 1), 0);
+    meshSphereInto<V>(slices, stacks, vertices, indices);
+}
+
+/**
+ * Torus around the y axis centered at the origin.
+ *
+ * @tparam V Vertex format.
+ * @tparam Rings Divisions around y.
+ * @tparam Sides Divisions around the tube.
+ * @param major Distance from the center to the middle of the tube.
+ * @param minor Tube radius.
+ */
+template <class V, int Rings, int Sides>
+constexpr Mesh<V, (Rings + 1) * (Sides + 1), 6 * Rings * Sides> meshTorus(double major = 0.35, double minor = 0.15)
+{
+    Mesh<V, (Rings + 1) * (Sides + 1), 6 * Rings * Sides> mesh{};
+    int vertex = 0;
+
+    // Tube angle runs so that (ring, side) is counter-clockwise seen from outside.
+    for (int j = 0; j <= Sides; j++)
+    {
+        double phi = 2.0 * MESH_PI * j / Sides;
+        for (int i = 0; i <= Rings; i++)
+        {
+            double theta = 2.0 * MESH_PI * i / Rings;
+            double nx = meshCos(phi) * meshCos(theta);
+            double ny = -meshSin(phi);
+            double nz = meshCos(phi) * meshSin(theta);
+            mesh.vertices[vertex++] = V::make(meshAttributes(major * meshCos(theta) + minor * nx, minor * ny,
+                                                             major * meshSin(theta) + minor * nz, nx, ny, nz,
+                                                             (double)i / Rings, (double)j / Sides));
+        }
+    }
+    meshGridIndices(mesh.indices, 0, 0, Rings, Sides);
+    return mesh;
+}
+
+/**
+ * Unit grid on the xz plane centered at the origin, facing +y.
+ *
+ * @tparam V Vertex format.
+ * @tparam Columns Divisions along x.
+ * @tparam Rows Divisions along z.
+ */
+template <class V, int Columns, int Rows>
+constexpr Mesh<V, (Columns + 1) * (Rows + 1), 6 * Columns * Rows> meshGrid()
+{
+    Mesh<V, (Columns + 1) * (Rows + 1), 6 * Columns * Rows> mesh{};
+    int vertex = 0;
+
+    for (int j = 0; j <= Rows; j++)
+        for (int i = 0; i <= Columns; i++)
+        {
+            double u = (double)i / Columns, v = (double)j / Rows;
+            mesh.vertices[vertex++] = V::make(meshAttributes(u - 0.5, 0.0, 0.5 - v, 0.0, 1.0, 0.0, u, v));
+        }
+    meshGridIndices(mesh.indices, 0, 0, Columns, Rows);
+    return mesh;
+}
+
+/**
+ * Non-indexed copy of a mesh.
+ *
+ * One vertex per index, in triangle order, for glDrawArrays.
+ *
+ * @param mesh Indexed mesh.
+ * @return Vertex array.
+ */
+template <class V, int VertexCount, int IndexCount>
+constexpr std::array<V, IndexCount> meshExpand(const Mesh<V, VertexCount, IndexCount> &mesh)
+{
+    std::array<V, IndexCount> vertices{};
+    for (int i = 0; i < IndexCount; i++)
+        vertices[i] = mesh.vertices[mesh.indices[i]];
+    return vertices;
+}
+
+#endif
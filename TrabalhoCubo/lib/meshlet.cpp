@@ -0,0 +1,375 @@
+/**
+ * @file meshlet.cpp
+ * Meshlets and CPU meshlet culling.
+ *
+ * Implements meshlet building, the SIMD bounds tests (GCC vector
+ * extensions, four meshlets per step) and the worker threads.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "meshlet.h"
+#include "trace.h"
+
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+
+
+/** Compute the bounds of the meshlet's triangles. */
+static void meshletBounds(Meshlet &m, const unsigned int *indices, const float *positions, int stride)
+{
+    float lo[3], hi[3];
+    const float *p0 = positions + indices[0] * stride;
+    for (int k = 0; k < 3; k++)
+        lo[k] = hi[k] = p0[k];
+    for (unsigned int i = 1; i < m.indexCount; i++)
+    {
+        const float *p = positions + indices[i] * stride;
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = fminf(lo[k], p[k]);
+            hi[k] = fmaxf(hi[k], p[k]);
+        }
+    }
+
+    float r2 = 0.0f;
+    for (int k = 0; k < 3; k++)
+        m.center[k] = 0.5f * (lo[k] + hi[k]);
+    for (unsigned int i = 0; i < m.indexCount; i++)
+    {
+        const float *p = positions + indices[i] * stride;
+        float dx = p[0] - m.center[0], dy = p[1] - m.center[1], dz = p[2] - m.center[2];
+        r2 = fmaxf(r2, dx * dx + dy * dy + dz * dz);
+    }
+    m.radius = sqrtf(r2);
+
+    // Cone: mean of the unit normals, opened to the widest triangle.
+    std::vector<float> normals;
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (unsigned int t = 0; t < m.indexCount; t += 3)
+    {
+        const float *a = positions + indices[t] * stride;
+        const float *b = positions + indices[t + 1] * stride;
+        const float *c = positions + indices[t + 2] * stride;
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len == 0.0f)
+            continue;
+        for (int k = 0; k < 3; k++)
+        {
+            normals.push_back(n[k] / len);
+            axis[k] += n[k] / len;
+        }
+    }
+
+    float len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float minDot = 1.0f;
+    for (int k = 0; k < 3; k++)
+        m.coneAxis[k] = len > 0.0f ? axis[k] / len : 0.0f;
+    for (size_t i = 0; i < normals.size(); i += 3)
+        minDot = fminf(minDot, normals[i] * m.coneAxis[0] + normals[i + 1] * m.coneAxis[1] +
+                               normals[i + 2] * m.coneAxis[2]);
+
+    // Spread close to or past 90 degrees: the cone can never be fully backfacing.
+    m.coneCutoff = (len == 0.0f || minDot <= 0.1f) ? 2.0f : sqrtf(1.0f - minDot * minDot);
+}
+
+MeshletSet buildMeshlets(const unsigned int *indices, int indexCount, const float *positions, int stride,
+                         int vertexCount, int maxVertices, int maxTriangles)
+{
+    MeshletSet set;
+    set.indices.reserve(indexCount);
+
+    // marker[v] is the meshlet that last took vertex v.
+    std::vector<int> marker(vertexCount, -1);
+    Meshlet current = {};
+
+    for (int t = 0; t + 2 < indexCount; t += 3)
+    {
+        const unsigned int *tri = indices + t;
+        int id = set.meshlets.size();
+        int added = (marker[tri[0]] != id) + (marker[tri[1]] != id && tri[1] != tri[0]) +
+                    (marker[tri[2]] != id && tri[2] != tri[0] && tri[2] != tri[1]);
+
+        if (current.vertexCount + added > (unsigned int)maxVertices ||
+            current.indexCount / 3 == (unsigned int)maxTriangles)
+        {
+            meshletBounds(current, &set.indices[current.firstIndex], positions, stride);
+            set.meshlets.push_back(current);
+
+            current = Meshlet();
+            current.firstIndex = set.indices.size();
+            id++;
+            added = 1 + (tri[1] != tri[0]) + (tri[2] != tri[0] && tri[2] != tri[1]);
+        }
+
+        for (int k = 0; k < 3; k++)
+            marker[tri[k]] = id;
+        current.vertexCount += added;
+        current.indexCount += 3;
+        set.indices.insert(set.indices.end(), tri, tri + 3);
+    }
+
+    if (current.indexCount)
+    {
+        meshletBounds(current, &set.indices[current.firstIndex], positions, stride);
+        set.meshlets.push_back(current);
+    }
+    return set;
+}
+
+
+MeshletCuller::MeshletCuller(int threadCount)
+    : count(0), phase(PHASE_CULL), parts(1), generation(0), pending(0), quit(false)
+{
+    memset(&lastStats, 0, sizeof(lastStats));
+
+    if (threadCount < 0)
+    {
+        int hardware = std::thread::hardware_concurrency();
+        threadCount = hardware > 1 ? hardware - 1 : 0;
+    }
+    partStats.resize(threadCount + 1);
+    partOffsets.resize(threadCount + 2);
+    for (int i = 0; i < threadCount; i++)
+        threads.push_back(std::thread(&MeshletCuller::worker, this, i + 1));
+}
+
+MeshletCuller::~MeshletCuller()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+void MeshletCuller::setMeshlets(const MeshletSet &set)
+{
+    count = set.meshlets.size();
+    size_t padded = (count + 3) & ~3;
+
+    std::vector<float> *arrays[] = { &cx, &cy, &cz, &radius, &ax, &ay, &az, &cutoff };
+    for (int a = 0; a < 8; a++)
+        arrays[a]->assign(padded, 0.0f);
+    firstIndex.resize(count);
+    indexCount.resize(count);
+    visible.assign(padded, 0);
+
+    for (int i = 0; i < count; i++)
+    {
+        const Meshlet &m = set.meshlets[i];
+        cx[i] = m.center[0];
+        cy[i] = m.center[1];
+        cz[i] = m.center[2];
+        radius[i] = m.radius;
+        ax[i] = m.coneAxis[0];
+        ay[i] = m.coneAxis[1];
+        az[i] = m.coneAxis[2];
+        cutoff[i] = m.coneCutoff;
+        firstIndex[i] = m.firstIndex;
+        indexCount[i] = m.indexCount;
+    }
+    sourceIndices = set.indices;
+}
+
+void MeshletCuller::worker(int part)
+{
+    TRACE_THREAD_NAME("meshlet worker");
+    unsigned int seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quit || generation != seen; });
+            if (quit)
+                return;
+            seen = generation;
+            if (part >= parts)
+                continue;
+        }
+
+        runPart(part);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+            done.notify_one();
+    }
+}
+
+void MeshletCuller::run(Phase newPhase, int newParts)
+{
+    if (newParts == 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            phase = newPhase;
+            parts = 1;
+        }
+        runPart(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        phase = newPhase;
+        parts = newParts;
+        pending = newParts - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    runPart(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == 0; });
+}
+
+void MeshletCuller::partRange(int part, int &first, int &end) const
+{
+    int groups = (count + 3) / 4;
+    first = groups * part / parts * 4;
+    end = groups * (part + 1) / parts * 4;
+    if (end > count)
+        end = count;
+}
+
+void MeshletCuller::runPart(int part)
+{
+    TRACE_SCOPE(phase == PHASE_CULL ? "meshlet cull" : "meshlet compact");
+    int first, end;
+    partRange(part, first, end);
+
+    if (phase == PHASE_COMPACT)
+    {
+        unsigned int *out = compacted.data() + partOffsets[part];
+        for (int i = first; i < end; i++)
+            if (visible[i])
+            {
+                memcpy(out, &sourceIndices[firstIndex[i]], indexCount[i] * sizeof(unsigned int));
+                out += indexCount[i];
+            }
+        return;
+    }
+
+    MeshletCullStats &stats = partStats[part];
+    memset(&stats, 0, sizeof(stats));
+
+    v4sf zero = { 0.0f, 0.0f, 0.0f, 0.0f };
+    v4sf ex = zero + camera[0], ey = zero + camera[1], ez = zero + camera[2];
+
+    for (int i = first; i < end; i += 4)
+    {
+        v4sf x, y, z, r, nx, ny, nz, c;
+        memcpy(&x, &cx[i], sizeof(v4sf));
+        memcpy(&y, &cy[i], sizeof(v4sf));
+        memcpy(&z, &cz[i], sizeof(v4sf));
+        memcpy(&r, &radius[i], sizeof(v4sf));
+        memcpy(&nx, &ax[i], sizeof(v4sf));
+        memcpy(&ny, &ay[i], sizeof(v4sf));
+        memcpy(&nz, &az[i], sizeof(v4sf));
+        memcpy(&c, &cutoff[i], sizeof(v4sf));
+
+        // Outside: the sphere is wholly behind one of the planes.
+        v4si outside = { 0, 0, 0, 0 };
+        for (int p = 0; p < 6; p++)
+        {
+            v4sf d = x * planes[p][0] + y * planes[p][1] + z * planes[p][2] + planes[p][3];
+            outside |= d < -r;
+        }
+
+        // Backfacing: dot(center - eye, axis) >= cutoff * |center - eye| + radius,
+        // squared to avoid the square root (both sides are non negative).
+        v4sf dx = x - ex, dy = y - ey, dz = z - ez;
+        v4sf d = dx * nx + dy * ny + dz * nz - r;
+        v4sf dist2 = dx * dx + dy * dy + dz * dz;
+        v4si backfacing = (d >= zero) & (d * d >= c * c * dist2);
+
+        int lanes = end - i < 4 ? end - i : 4;
+        for (int l = 0; l < lanes; l++)
+        {
+            bool out = outside[l] != 0, back = backfacing[l] != 0;
+            visible[i + l] = !out && !back;
+            if (out)
+                stats.outside++;
+            else if (back)
+                stats.backfacing++;
+            else
+            {
+                stats.visible++;
+                stats.triangles += indexCount[i + l] / 3;
+            }
+        }
+    }
+}
+
+void MeshletCuller::cull(const float *mvp, const float *eye, MeshletOutput output)
+{
+    memset(&lastStats, 0, sizeof(lastStats));
+    lastStats.meshlets = count;
+    compacted.clear();
+    drawCounts.clear();
+    drawOffsets.clear();
+    if (count == 0)
+        return;
+
+    // Frustum planes from the rows of the matrix (Gribb and Hartmann),
+    // normalized so plane distances compare with radii.
+    for (int p = 0; p < 6; p++)
+    {
+        int row = p / 2;
+        float sign = p % 2 == 0 ? 1.0f : -1.0f;
+        for (int k = 0; k < 4; k++)
+            planes[p][k] = mvp[k * 4 + 3] + sign * mvp[k * 4 + row];
+        float len = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        for (int k = 0; k < 4; k++)
+            planes[p][k] /= len > 0.0f ? len : 1.0f;
+    }
+    for (int k = 0; k < 3; k++)
+        camera[k] = eye[k];
+
+    int useParts = count / MIN_PER_THREAD;
+    if (useParts > (int)threads.size() + 1)
+        useParts = threads.size() + 1;
+    if (useParts < 1)
+        useParts = 1;
+
+    run(PHASE_CULL, useParts);
+
+    partOffsets[0] = 0;
+    for (int p = 0; p < useParts; p++)
+    {
+        lastStats.visible += partStats[p].visible;
+        lastStats.backfacing += partStats[p].backfacing;
+        lastStats.outside += partStats[p].outside;
+        lastStats.triangles += partStats[p].triangles;
+        partOffsets[p + 1] = partOffsets[p] + partStats[p].triangles * 3;
+    }
+
+    if (output == MESHLET_COMPACT_INDICES)
+    {
+        compacted.resize(lastStats.triangles * 3);
+        run(PHASE_COMPACT, useParts);
+        return;
+    }
+
+    // Visible meshlets are consecutive in the index buffer: merge neighbours.
+    for (int i = 0; i < count; i++)
+    {
+        if (!visible[i])
+            continue;
+        const void *offset = (const void *)(firstIndex[i] * sizeof(unsigned int));
+        if (i > 0 && visible[i - 1])
+            drawCounts.back() += indexCount[i];
+        else
+        {
+            drawCounts.push_back(indexCount[i]);
+            drawOffsets.push_back(offset);
+        }
+    }
+}
@@ -0,0 +1,192 @@
+/**
+ * @file meshlet.h
+ * Meshlets and CPU meshlet culling.
+ *
+ * A mesh is split at load time into meshlets: small groups of triangles
+ * (at most 64 vertices and 124 triangles by default) with a bounding sphere
+ * and a normal cone. Each frame MeshletCuller tests every meshlet against
+ * the view frustum and against its cone (all triangles facing away from
+ * the camera), four meshlets per SIMD step and split across worker
+ * threads, and returns only the surviving triangles, either as a compacted
+ * index list or as ranges for glMultiDrawElements.
+ *
+ * Tests run in object space: the frustum planes are taken from the model
+ * view projection matrix and the camera position is given in object
+ * coordinates, so no per-meshlet transform is needed.
+ */
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+
+/** Default meshlet limits. */
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+/** A group of triangles with its bounds. */
+struct Meshlet
+{
+    /** First index in MeshletSet::indices. */
+    unsigned int firstIndex;
+    /** Number of indices (three per triangle). */
+    unsigned int indexCount;
+    /** Distinct vertices referenced. */
+    unsigned int vertexCount;
+    /** Bounding sphere center. */
+    float center[3];
+    /** Bounding sphere radius. */
+    float radius;
+    /** Average normal direction (unit). */
+    float coneAxis[3];
+    /** Sine of the normal spread; above 1 the cone never culls. */
+    float coneCutoff;
+};
+
+/** Meshlets of a mesh. */
+struct MeshletSet
+{
+    std::vector<Meshlet> meshlets;
+    /** Triangle list grouped by meshlet, with the mesh's vertex indices. */
+    std::vector<unsigned int> indices;
+};
+
+/**
+ * Build meshlets.
+ *
+ * Triangles are taken greedily in order, so a cache-optimized list (see
+ * meshopt.h) gives compact meshlets.
+ *
+ * @param indices Triangle list.
+ * @param indexCount Number of indices.
+ * @param positions First vertex position (x, y, z).
+ * @param stride Floats between consecutive positions.
+ * @param vertexCount Number of vertices.
+ * @param maxVertices Vertex limit per meshlet.
+ * @param maxTriangles Triangle limit per meshlet.
+ * @return Meshlets and their index list.
+ */
+MeshletSet buildMeshlets(const unsigned int *indices, int indexCount, const float *positions, int stride,
+                         int vertexCount, int maxVertices = MESHLET_MAX_VERTICES,
+                         int maxTriangles = MESHLET_MAX_TRIANGLES);
+
+/** Culling output. */
+enum MeshletOutput
+{
+    /** Copy the surviving triangles into one index list. */
+    MESHLET_COMPACT_INDICES,
+    /** Ranges of the meshlet index buffer, for glMultiDrawElements. */
+    MESHLET_MULTIDRAW
+};
+
+/** Counters of the last cull. */
+struct MeshletCullStats
+{
+    unsigned int meshlets;
+    unsigned int visible;
+    /** Rejected by the normal cone. */
+    unsigned int backfacing;
+    /** Rejected by the frustum. */
+    unsigned int outside;
+    /** Triangles kept. */
+    unsigned int triangles;
+};
+
+/**
+ * Per-frame meshlet culling.
+ */
+class MeshletCuller
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param threads Worker threads besides the caller; -1 uses the
+     *        hardware concurrency.
+     */
+    MeshletCuller(int threads = -1);
+    ~MeshletCuller();
+
+    /**
+     * Set meshlets.
+     *
+     * Copies the bounds into SIMD friendly arrays.
+     *
+     * @param set Meshlets (the index list is copied for compaction).
+     */
+    void setMeshlets(const MeshletSet &set);
+
+    /**
+     * Cull.
+     *
+     * @param mvp Model view projection matrix (16 floats, column major).
+     * @param eye Camera position in object space.
+     * @param output What to produce.
+     */
+    void cull(const float *mvp, const float *eye, MeshletOutput output);
+
+    /** Surviving triangles (MESHLET_COMPACT_INDICES). */
+    const std::vector<unsigned int> &indices() const { return compacted; }
+
+    /** Index counts of the surviving ranges (MESHLET_MULTIDRAW). */
+    const std::vector<GLsizei> &counts() const { return drawCounts; }
+
+    /** Byte offsets of the surviving ranges in the meshlet index buffer (MESHLET_MULTIDRAW). */
+    const std::vector<const void *> &offsets() const { return drawOffsets; }
+
+    /** Counters of the last cull. */
+    const MeshletCullStats &stats() const { return lastStats; }
+
+    /** Meshlets per thread below which culling stays on the caller. */
+    static const int MIN_PER_THREAD = 1024;
+
+private:
+    /** Work split across threads. */
+    enum Phase
+    {
+        PHASE_CULL,
+        PHASE_COMPACT
+    };
+
+    /** Run a phase over parts 0 to parts - 1, the caller taking part 0. */
+    void run(Phase phase, int parts);
+    /** Run part of the current phase. */
+    void runPart(int part);
+    /** Worker thread loop. */
+    void worker(int part);
+    /** Meshlets [first, end) of a part (multiples of 4 except the last end). */
+    void partRange(int part, int &first, int &end) const;
+
+    // Bounds, structure of arrays padded to a multiple of 4.
+    std::vector<float> cx, cy, cz, radius, ax, ay, az, cutoff;
+    std::vector<unsigned int> firstIndex, indexCount;
+    std::vector<unsigned int> sourceIndices;
+    int count;
+
+    // State of the current cull, shared with the workers.
+    float planes[6][4];
+    float camera[3];
+    std::vector<unsigned char> visible;
+    std::vector<MeshletCullStats> partStats;
+    std::vector<unsigned int> partOffsets;
+    std::vector<unsigned int> compacted;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void *> drawOffsets;
+    MeshletCullStats lastStats;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    Phase phase;
+    int parts;
+    unsigned int generation;
+    int pending;
+    bool quit;
+};
+
+#endif
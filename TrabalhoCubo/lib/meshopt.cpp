@@ -0,0 +1,358 @@
+/**
+ * @file meshopt.cpp
+ * Mesh optimization.
+ *
+ * Implements the cache simulation and the three reordering passes.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "meshopt.h"
+
+
+/** Entries of the LRU cache modelled by the Forsyth scores. */
+#define FORSYTH_CACHE 32
+
+
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, int indexCount, int vertexCount,
+                                    int cacheSize)
+{
+    // FIFO: a vertex enters when it misses and never moves on a hit.
+    std::vector<unsigned int> timestamp(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    int misses = 0;
+
+    for (int i = 0; i < indexCount; i++)
+    {
+        unsigned int v = indices[i];
+        if (time - timestamp[v] > (unsigned int)cacheSize)
+        {
+            timestamp[v] = time++;
+            misses++;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.acmr = indexCount ? misses / (indexCount / 3.0f) : 0.0f;
+    stats.atvr = vertexCount ? misses / (float)vertexCount : 0.0f;
+    return stats;
+}
+
+/** Forsyth vertex score from the cache position and remaining triangles. */
+static float forsythScore(int position, int valence)
+{
+    if (valence == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (position >= 0)
+    {
+        // The last triangle's vertices get a fixed score so it is not
+        // simply repeated around a fan.
+        if (position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (position - 3) / (float)(FORSYTH_CACHE - 3), 1.5f);
+    }
+    // Prefer finishing vertices with few triangles left.
+    return score + 2.0f / sqrtf((float)valence);
+}
+
+void optimizeVertexCache(unsigned int *indices, int indexCount, int vertexCount)
+{
+    int triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles of each vertex, in a single array.
+    std::vector<int> valence(vertexCount, 0);
+    for (int i = 0; i < indexCount; i++)
+        valence[indices[i]]++;
+
+    std::vector<int> offsets(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + valence[v];
+
+    std::vector<int> adjacency(indexCount);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (int t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+
+    std::vector<float> vertexScore(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        vertexScore[v] = forsythScore(-1, valence[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    for (int t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] +
+                           vertexScore[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> output;
+    output.reserve(indexCount);
+    std::vector<int> cache, next;
+    cache.reserve(FORSYTH_CACHE + 3);
+    next.reserve(FORSYTH_CACHE + 3);
+
+    int best = (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    int cursor = 0;
+
+    while (true)
+    {
+        // No candidate around the cache: continue with the next unused
+        // triangle in input order (cheaper than a full search, nearly as good).
+        if (best < 0)
+        {
+            while (cursor < triangleCount && emitted[cursor])
+                cursor++;
+            if (cursor == triangleCount)
+                break;
+            best = cursor;
+        }
+
+        emitted[best] = 1;
+        const unsigned int *tri = &indices[best * 3];
+        output.insert(output.end(), tri, tri + 3);
+
+        // Remove the triangle from its vertices' lists.
+        for (int k = 0; k < 3; k++)
+        {
+            int v = tri[k];
+            int *list = &adjacency[offsets[v]];
+            for (int i = 0; i < valence[v]; i++)
+                if (list[i] == best)
+                {
+                    list[i] = list[valence[v] - 1];
+                    break;
+                }
+            valence[v]--;
+        }
+
+        // New LRU cache: the triangle first, then the old entries.
+        next.assign(tri, tri + 3);
+        for (size_t i = 0; i < cache.size(); i++)
+            if (cache[i] != (int)tri[0] && cache[i] != (int)tri[1] && cache[i] != (int)tri[2])
+                next.push_back(cache[i]);
+        cache.swap(next);
+
+        // Rescore cached vertices (and those just evicted) and their triangles.
+        best = -1;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < cache.size(); i++)
+        {
+            int v = cache[i];
+            int p = i < FORSYTH_CACHE ? (int)i : -1;
+            float score = forsythScore(p, valence[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+
+            for (int j = 0; j < valence[v]; j++)
+            {
+                int t = adjacency[offsets[v] + j];
+                triangleScore[t] += delta;
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (cache.size() > FORSYTH_CACHE)
+            cache.resize(FORSYTH_CACHE);
+    }
+
+    memcpy(indices, output.data(), indexCount * sizeof(unsigned int));
+}
+
+/** A run of triangles moved as a whole by the overdraw pass. */
+struct OverdrawCluster
+{
+    int first, count;
+    float sortKey;
+};
+
+/**
+ * Split points where the cluster can end.
+ *
+ * Hard boundaries are triangles whose three vertices all miss the cache:
+ * there the cache order starts over and cutting costs nothing.
+ */
+static void hardBoundaries(const unsigned int *indices, int triangleCount, int vertexCount,
+                           std::vector<int> &starts)
+{
+    std::vector<unsigned int> timestamp(vertexCount, 0);
+    unsigned int time = 17;
+
+    for (int t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (time - timestamp[v] > 16)
+            {
+                timestamp[v] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3)
+            starts.push_back(t);
+    }
+}
+
+/** Misses of triangles first to first + count with an empty cache, per prefix. */
+static void prefixMisses(const unsigned int *indices, int first, int count,
+                         std::vector<unsigned int> &timestamp, unsigned int &time, std::vector<int> &misses)
+{
+    // Advancing time past the cache size empties it for this run.
+    time += 17;
+    misses.assign(count + 1, 0);
+    for (int t = 0; t < count; t++)
+    {
+        int m = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[(first + t) * 3 + k];
+            if (time - timestamp[v] > 16)
+            {
+                timestamp[v] = time++;
+                m++;
+            }
+        }
+        misses[t + 1] = misses[t] + m;
+    }
+}
+
+void optimizeOverdraw(unsigned int *indices, int indexCount, const float *positions, int stride,
+                      int vertexCount, float threshold)
+{
+    int triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    std::vector<int> starts;
+    hardBoundaries(indices, triangleCount, vertexCount, starts);
+    starts.push_back(triangleCount);
+
+    // Soft boundaries: end each part at the first prefix whose ACMR is
+    // within threshold of the whole hard cluster's.
+    std::vector<OverdrawCluster> clusters;
+    std::vector<unsigned int> timestamp(vertexCount, 0);
+    std::vector<int> misses;
+    unsigned int time = 0;
+    for (size_t c = 0; c + 1 < starts.size(); c++)
+    {
+        int first = starts[c], end = starts[c + 1];
+        while (first < end)
+        {
+            int count = end - first;
+            prefixMisses(indices, first, count, timestamp, time, misses);
+            float limit = threshold * misses[count] / (float)count;
+
+            int cut = count;
+            for (int n = 1; n < count; n++)
+                if (misses[n] <= limit * n)
+                {
+                    cut = n;
+                    break;
+                }
+
+            OverdrawCluster cluster = { first, cut, 0.0f };
+            clusters.push_back(cluster);
+            first += cut;
+        }
+    }
+    if (clusters.size() < 2)
+        return;
+
+    // Mesh centroid, area weighted.
+    std::vector<float> centroid(clusters.size() * 3), normal(clusters.size() * 3);
+    double mesh[3] = { 0.0, 0.0, 0.0 }, meshArea = 0.0;
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        double area = 0.0, cc[3] = { 0.0, 0.0, 0.0 }, cn[3] = { 0.0, 0.0, 0.0 };
+        for (int t = clusters[c].first; t < clusters[c].first + clusters[c].count; t++)
+        {
+            const float *a = positions + indices[t * 3] * stride;
+            const float *b = positions + indices[t * 3 + 1] * stride;
+            const float *d = positions + indices[t * 3 + 2] * stride;
+            double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            double e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                            e1[0] * e2[1] - e1[1] * e2[0] };
+            double w = 0.5 * sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++)
+            {
+                cc[k] += w * (a[k] + b[k] + d[k]) / 3.0;
+                cn[k] += n[k];
+            }
+            area += w;
+        }
+
+        double len = sqrt(cn[0] * cn[0] + cn[1] * cn[1] + cn[2] * cn[2]);
+        for (int k = 0; k < 3; k++)
+        {
+            centroid[c * 3 + k] = area > 0.0 ? cc[k] / area : 0.0;
+            normal[c * 3 + k] = len > 0.0 ? cn[k] / len : 0.0;
+            mesh[k] += cc[k];
+        }
+        meshArea += area;
+    }
+    for (int k = 0; k < 3; k++)
+        mesh[k] = meshArea > 0.0 ? mesh[k] / meshArea : 0.0;
+
+    // Clusters far out along their normal are likely to occlude: draw first.
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        float key = 0.0f;
+        for (int k = 0; k < 3; k++)
+            key += (centroid[c * 3 + k] - mesh[k]) * normal[c * 3 + k];
+        clusters[c].sortKey = key;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const OverdrawCluster &a, const OverdrawCluster &b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indexCount);
+    for (size_t c = 0; c < clusters.size(); c++)
+        output.insert(output.end(), indices + clusters[c].first * 3,
+                      indices + (clusters[c].first + clusters[c].count) * 3);
+    memcpy(indices, output.data(), output.size() * sizeof(unsigned int));
+}
+
+int optimizeVertexFetch(unsigned int *indices, int indexCount, void *vertices, int vertexCount,
+                        int vertexSize)
+{
+    std::vector<int> remap(vertexCount, -1);
+    int next = 0;
+    for (int i = 0; i < indexCount; i++)
+    {
+        if (remap[indices[i]] < 0)
+            remap[indices[i]] = next++;
+        indices[i] = remap[indices[i]];
+    }
+
+    std::vector<unsigned char> copy((unsigned char *)vertices, (unsigned char *)vertices + (size_t)vertexCount * vertexSize);
+    for (int v = 0; v < vertexCount; v++)
+        if (remap[v] >= 0)
+            memcpy((unsigned char *)vertices + (size_t)remap[v] * vertexSize, &copy[(size_t)v * vertexSize], vertexSize);
+    return next;
+}
+
+MeshOptimizeStats optimizeMesh(unsigned int *indices, int indexCount, void *vertices, int vertexCount,
+                               int vertexSize, int positionOffset)
+{
+    MeshOptimizeStats stats;
+    stats.before = analyzeVertexCache(indices, indexCount, vertexCount);
+
+    optimizeVertexCache(indices, indexCount, vertexCount);
+    optimizeOverdraw(indices, indexCount, (const float *)((unsigned char *)vertices + positionOffset),
+                     vertexSize / sizeof(float), vertexCount);
+    stats.vertexCount = optimizeVertexFetch(indices, indexCount, vertices, vertexCount, vertexSize);
+
+    stats.after = analyzeVertexCache(indices, indexCount, stats.vertexCount);
+    return stats;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file meshopt.h
+ * Mesh optimization.
+ *
+ * Reorders indexed triangle meshes at load time for the GPU:
+ *
+ * - vertex cache: Forsyth's linear-speed ordering, so consecutive
+ *   triangles reuse recently transformed vertices;
+ * - overdraw: the cache-ordered list is cut into clusters (Tipsify style)
+ *   and clusters facing outwards are drawn first, so they occlude the
+ *   rest without giving back much of the cache gain;
+ * - vertex fetch: vertices are renumbered in order of first use, so
+ *   fetches walk the vertex buffer linearly.
+ *
+ * Run them in this order. Quality is measured as ACMR (vertices
+ * transformed per triangle; 0.5 is the ideal for large regular meshes, 3
+ * the worst) and ATVR (vertices transformed per vertex; 1 is ideal) on a
+ * FIFO cache simulation.
+ */
+
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+
+/** Post-transform cache efficiency. */
+struct VertexCacheStats
+{
+    /** Average cache miss ratio: transformed vertices per triangle. */
+    float acmr;
+    /** Average transform to vertex ratio: transformed vertices per vertex. */
+    float atvr;
+};
+
+/** Result of optimizeMesh(). */
+struct MeshOptimizeStats
+{
+    /** Cache efficiency of the original order. */
+    VertexCacheStats before;
+    /** Cache efficiency of the optimized order. */
+    VertexCacheStats after;
+    /** Vertices kept (unreferenced ones are dropped). */
+    int vertexCount;
+};
+
+/**
+ * Simulate a FIFO post-transform cache.
+ *
+ * @param indices Triangle list.
+ * @param indexCount Number of indices.
+ * @param vertexCount Number of vertices.
+ * @param cacheSize Cache entries.
+ * @return ACMR and ATVR.
+ */
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, int indexCount, int vertexCount,
+                                    int cacheSize = 16);
+
+/**
+ * Reorder triangles for the vertex cache.
+ *
+ * @param indices Triangle list (reordered in place).
+ * @param indexCount Number of indices.
+ * @param vertexCount Number of vertices.
+ */
+void optimizeVertexCache(unsigned int *indices, int indexCount, int vertexCount);
+
+/**
+ * Reorder clusters of triangles to reduce overdraw.
+ *
+ * Expects a cache-optimized list. Clusters end where the cache order
+ * restarts, and are split further while each part keeps its ACMR within
+ * threshold times that of the whole cluster.
+ *
+ * @param indices Triangle list (reordered in place).
+ * @param indexCount Number of indices.
+ * @param positions First vertex position (x, y, z).
+ * @param stride Floats between consecutive positions.
+ * @param vertexCount Number of vertices.
+ * @param threshold Largest ACMR increase allowed (1.05 gives up 5%).
+ */
+void optimizeOverdraw(unsigned int *indices, int indexCount, const float *positions, int stride,
+                      int vertexCount, float threshold = 1.05f);
+
+/**
+ * Reorder vertices in order of first use.
+ *
+ * @param indices Triangle list (renumbered in place).
+ * @param indexCount Number of indices.
+ * @param vertices Vertex data (reordered in place).
+ * @param vertexCount Number of vertices.
+ * @param vertexSize Bytes per vertex.
+ * @return Vertices kept, at the start of the array.
+ */
+int optimizeVertexFetch(unsigned int *indices, int indexCount, void *vertices, int vertexCount,
+                        int vertexSize);
+
+/**
+ * Run the three passes.
+ *
+ * @param indices Triangle list (optimized in place).
+ * @param indexCount Number of indices.
+ * @param vertices Interleaved vertex data (optimized in place).
+ * @param vertexCount Number of vertices.
+ * @param vertexSize Bytes per vertex (a multiple of 4).
+ * @param positionOffset Byte offset of the float position in a vertex.
+ * @return Cache efficiency before and after.
+ */
+MeshOptimizeStats optimizeMesh(unsigned int *indices, int indexCount, void *vertices, int vertexCount,
+                               int vertexSize, int positionOffset);
+
+#endif
@@ -0,0 +1,335 @@
+/**
+ * @file multidraw.cpp
+ * Multi-draw indirect submission.
+ *
+ * Implements the mesh bounds, the per-frame culling and command building
+ * and the three submission paths.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "multidraw.h"
+#include "utils.h"
+#include "framearena.h"
+
+
+#define MULTIDRAW_STR2(x) #x
+#define MULTIDRAW_STR(x) MULTIDRAW_STR2(x)
+
+// The layout comes from multidraw.h; the material is the last texel of an object.
+const char *MULTIDRAW_GLSL = "\n"
+"layout (location = " MULTIDRAW_STR(MULTIDRAW_ID_LOCATION) ") in uint drawID;\n"
+"\n"
+"uniform samplerBuffer drawData;\n"
+"\n"
+"const int drawTexels = " MULTIDRAW_STR(MULTIDRAW_TEXELS) ";\n"
+"\n"
+"mat4 drawModel()\n"
+"{\n"
+"    int base = int(drawID) * drawTexels;\n"
+"    return mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1),\n"
+"                texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));\n"
+"}\n"
+"\n"
+"vec4 drawMaterial()\n"
+"{\n"
+"    return texelFetch(drawData, int(drawID) * drawTexels + drawTexels - 1);\n"
+"}\n";
+
+static_assert(MULTIDRAW_TEXELS == 5, "drawModel() reads four texels and the material one more (see submit())");
+
+
+const char *multiDrawPathName(MultiDrawPath path)
+{
+    switch (path)
+    {
+        case MULTIDRAW_INDIRECT:      return "glMultiDrawElementsIndirect";
+        case MULTIDRAW_BASE_INSTANCE: return "base instance";
+        default:                      return "GL 3.3";
+    }
+}
+
+MultiDraw::MultiDraw(GpuMeshHeap &heap, int vertexSize, int positionOffset, GpuVertexLayoutFunc layout)
+    : heap(heap), format(heap.addFormat(vertexSize, layout)), positionOffset(positionOffset), vaoReady(false),
+      idBuffer(0), dataBuffer(0), dataTexture(0), commandBuffer(0),
+      idCapacity(0), dataCapacity(0), commandCapacity(0)
+{
+    memset(&lastStats, 0, sizeof(lastStats));
+}
+
+MultiDraw::~MultiDraw()
+{
+    if (idBuffer)
+    {
+        GLuint buffers[] = { idBuffer, dataBuffer, commandBuffer };
+        glDeleteBuffers(3, buffers);
+        glDeleteTextures(1, &dataTexture);
+    }
+}
+
+void MultiDraw::computeBounds(PooledMesh &m, const void *vertices, int vertexCount) const
+{
+    int vertexSize = heap.stride(format);
+    const unsigned char *bytes = (const unsigned char *)vertices;
+
+    // Bounding sphere around the center of the bounding box.
+    float lo[3] = { 0.0f, 0.0f, 0.0f }, hi[3] = { 0.0f, 0.0f, 0.0f };
+    for (int v = 0; v < vertexCount; v++)
+    {
+        float p[3];
+        memcpy(p, bytes + (size_t)v * vertexSize + positionOffset, sizeof(p));
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = v == 0 || p[k] < lo[k] ? p[k] : lo[k];
+            hi[k] = v == 0 || p[k] > hi[k] ? p[k] : hi[k];
+        }
+    }
+    for (int k = 0; k < 3; k++)
+        m.center[k] = 0.5f * (lo[k] + hi[k]);
+
+    float r2 = 0.0f;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        float p[3];
+        memcpy(p, bytes + (size_t)v * vertexSize + positionOffset, sizeof(p));
+        float dx = p[0] - m.center[0], dy = p[1] - m.center[1], dz = p[2] - m.center[2];
+        r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+    }
+    m.radius = sqrtf(r2);
+}
+
+int MultiDraw::addMesh(const void *vertices, int vertexCount, const unsigned int *indices, int indexCount)
+{
+    PooledMesh m;
+    m.mesh = heap.addMesh(format, vertices, vertexCount, indices, indexCount);
+    computeBounds(m, vertices, vertexCount);
+    meshes.push_back(m);
+    return meshes.size() - 1;
+}
+
+void MultiDraw::replaceMesh(int mesh, const void *vertices, int vertexCount, const unsigned int *indices,
+                            int indexCount)
+{
+    PooledMesh &m = meshes[mesh];
+    heap.removeMesh(m.mesh);
+    m.mesh = heap.addMesh(format, vertices, vertexCount, indices, indexCount);
+    computeBounds(m, vertices, vertexCount);
+}
+
+void MultiDraw::create()
+{
+    if (idBuffer)
+        return;
+
+    GLuint buffers[3];
+    glGenBuffers(3, buffers);
+    idBuffer = buffers[0];
+    dataBuffer = buffers[1];
+    commandBuffer = buffers[2];
+
+    // The draw data is read through a buffer texture (GL 3.1).
+    glGenTextures(1, &dataTexture);
+    cacheBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, MULTIDRAW_TEXELS * 4 * sizeof(float), NULL, GL_STREAM_DRAW);
+    dataCapacity = MULTIDRAW_TEXELS * 4 * sizeof(float);
+    cacheBindTexture(0, GL_TEXTURE_BUFFER, dataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, dataBuffer);
+}
+
+unsigned int MultiDraw::vao()
+{
+    unsigned int v = heap.vao(format);
+    if (!vaoReady)
+    {
+        // Draw IDs 0, 1, 2, ...: instance i of a command with base instance b reads b + i.
+        // Plain draws of the same format read ID 0, which they ignore.
+        cacheBindVertexArray(v);
+        cacheBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+        glVertexAttribIPointer(MULTIDRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0, (void *)0);
+        glEnableVertexAttribArray(MULTIDRAW_ID_LOCATION);
+        glVertexAttribDivisor(MULTIDRAW_ID_LOCATION, 1);
+        vaoReady = true;
+    }
+    return v;
+}
+
+void MultiDraw::begin()
+{
+    objects.clear();
+}
+
+void MultiDraw::add(int mesh, const float *model, const float *material)
+{
+    Object o;
+    o.mesh = mesh;
+    memcpy(o.model, model, sizeof(o.model));
+    memcpy(o.material, material, sizeof(o.material));
+    objects.push_back(o);
+}
+
+MultiDrawPath MultiDraw::path() const
+{
+    if (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect)
+        return MULTIDRAW_INDIRECT;
+    if (GLEW_VERSION_4_2 || GLEW_ARB_base_instance)
+        return MULTIDRAW_BASE_INSTANCE;
+    return MULTIDRAW_LOOP;
+}
+
+void MultiDraw::build(const float *viewProjection)
+{
+    memset(&lastStats, 0, sizeof(lastStats));
+    lastStats.objects = objects.size();
+    create();
+
+    // Frustum planes from the rows of the matrix (Gribb and Hartmann).
+    float planes[6][4];
+    for (int p = 0; p < 6; p++)
+    {
+        int row = p / 2;
+        float sign = p % 2 == 0 ? 1.0f : -1.0f;
+        for (int k = 0; k < 4; k++)
+            planes[p][k] = viewProjection[k * 4 + 3] + sign * viewProjection[k * 4 + row];
+        float len = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        for (int k = 0; k < 4; k++)
+            planes[p][k] /= len > 0.0f ? len : 1.0f;
+    }
+
+    // Keep the objects whose transformed bounding sphere touches the frustum.
+    // The lists below only live until the upload: frame arena.
+    FrameArena &arena = frameArena();
+    int *visible = arena.allocate<int>(objects.size());
+    size_t count = 0;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const Object &o = objects[i];
+        const PooledMesh &m = meshes[o.mesh];
+        const float *a = o.model;
+
+        float c[3];
+        for (int k = 0; k < 3; k++)
+            c[k] = a[k] * m.center[0] + a[4 + k] * m.center[1] + a[8 + k] * m.center[2] + a[12 + k];
+        float scale = 0.0f;
+        for (int col = 0; col < 3; col++)
+            scale = std::max(scale, a[col * 4] * a[col * 4] + a[col * 4 + 1] * a[col * 4 + 1] +
+                                    a[col * 4 + 2] * a[col * 4 + 2]);
+        float r = m.radius * sqrtf(scale);
+
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+            inside = planes[p][0] * c[0] + planes[p][1] * c[1] + planes[p][2] * c[2] + planes[p][3] >= -r;
+
+        if (inside)
+            visible[count++] = i;
+        else
+            lastStats.culled++;
+    }
+
+    // Objects of the same mesh become the instances of one command: counting
+    // sort by mesh, stable, so objects keep their order within a mesh.
+    size_t *first = arena.allocate<size_t>(meshes.size() + 1);
+    memset(first, 0, (meshes.size() + 1) * sizeof(size_t));
+    for (size_t i = 0; i < count; i++)
+        first[objects[visible[i]].mesh + 1]++;
+    for (size_t m = 0; m < meshes.size(); m++)
+        first[m + 1] += first[m];
+    int *order = arena.allocate<int>(count);
+    for (size_t i = 0; i < count; i++)
+        order[first[objects[visible[i]].mesh]++] = visible[i];
+
+    float *drawData = arena.allocate<float>(count * MULTIDRAW_TEXELS * 4);
+    commands.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        const Object &o = objects[order[i]];
+        memcpy(&drawData[i * MULTIDRAW_TEXELS * 4], o.model, sizeof(o.model));
+        memcpy(&drawData[i * MULTIDRAW_TEXELS * 4 + 16], o.material, sizeof(o.material));
+
+        if (i == 0 || o.mesh != objects[order[i - 1]].mesh)
+        {
+            const PooledMesh &m = meshes[o.mesh];
+            DrawElementsIndirectCommand c = { (GLuint)m.mesh.indexCount, 0, heap.firstIndex(m.mesh),
+                                              heap.baseVertex(m.mesh), (GLuint)i };
+            commands.push_back(c);
+        }
+        commands.back().instanceCount++;
+    }
+    lastStats.commands = commands.size();
+
+    if (count == 0)
+        return;
+
+    size_t bytes = count * MULTIDRAW_TEXELS * 4 * sizeof(float);
+    cacheBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+    if (bytes > dataCapacity)
+    {
+        dataCapacity = bytes * 2;
+        glBufferData(GL_TEXTURE_BUFFER, dataCapacity, NULL, GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, drawData);
+
+    if (count > idCapacity)
+    {
+        idCapacity = count * 2;
+        drawIDs.resize(idCapacity);
+        for (size_t i = 0; i < idCapacity; i++)
+            drawIDs[i] = i;
+        cacheBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+        glBufferData(GL_ARRAY_BUFFER, idCapacity * sizeof(GLuint), drawIDs.data(), GL_STATIC_DRAW);
+    }
+
+    if (path() == MULTIDRAW_INDIRECT)
+    {
+        bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+        cacheBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        if (bytes > commandCapacity)
+        {
+            commandCapacity = bytes * 2;
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity, NULL, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, commands.data());
+    }
+}
+
+void MultiDraw::draw(unsigned int program, int unit)
+{
+    lastStats.calls = 0;
+    if (commands.empty())
+        return;
+
+    glUniform1i(glGetUniformLocation(program, "drawData"), unit);
+    cacheBindTexture(unit, GL_TEXTURE_BUFFER, dataTexture);
+    cacheBindVertexArray(vao());
+
+    MultiDrawPath p = path();
+    if (p == MULTIDRAW_INDIRECT)
+    {
+        cacheBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0, commands.size(), 0);
+        lastStats.calls = 1;
+        return;
+    }
+
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        const DrawElementsIndirectCommand &c = commands[i];
+        void *offset = (void *)(c.firstIndex * sizeof(unsigned int));
+        if (p == MULTIDRAW_BASE_INSTANCE)
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, c.count, GL_UNSIGNED_INT, offset,
+                                                          c.instanceCount, c.baseVertex, c.baseInstance);
+        else
+        {
+            // No base instance: start the draw ID attribute at the command's first object.
+            cacheBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+            glVertexAttribIPointer(MULTIDRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0,
+                                   (void *)(c.baseInstance * sizeof(GLuint)));
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, GL_UNSIGNED_INT, offset,
+                                              c.instanceCount, c.baseVertex);
+        }
+        lastStats.calls++;
+    }
+
+    if (p == MULTIDRAW_LOOP)
+        glVertexAttribIPointer(MULTIDRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0, (void *)0);
+}
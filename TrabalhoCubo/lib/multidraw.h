@@ -0,0 +1,197 @@
+/**
+ * @file multidraw.h
+ * Multi-draw indirect submission.
+ *
+ * Keeps many different meshes in the shared buffers of a GpuMeshHeap
+ * (one vertex format, so one VAO), so objects that differ only in mesh, transform and material
+ * share every piece of GL state. Each frame the objects are collected,
+ * culled against the view frustum, grouped by mesh and turned into
+ * indirect draw commands; a whole pass is then one
+ * glMultiDrawElementsIndirect call.
+ *
+ * Shaders find their object through a draw ID: a per-instance integer
+ * attribute at MULTIDRAW_ID_LOCATION which the commands' base instance
+ * offsets, so it counts the objects of the frame across all commands.
+ * The transform and material of each object are fetched with it from a
+ * buffer texture (MULTIDRAW_GLSL).
+ *
+ * Without ARB_multi_draw_indirect the same commands are issued one by one,
+ * with glDrawElementsInstancedBaseVertexBaseInstance when base instances
+ * are available and by moving the draw ID attribute otherwise (GL 3.3).
+ */
+
+#ifndef MULTIDRAW_H
+#define MULTIDRAW_H
+
+#include <vector>
+#include <GL/glew.h>
+#include "gpuheap.h"
+
+
+/** Attribute location of the draw ID (unsigned int, per instance). */
+#define MULTIDRAW_ID_LOCATION 7
+
+/** vec4 texels per object in the draw data buffer: model matrix columns, then material. */
+#define MULTIDRAW_TEXELS 5
+
+/**
+ * GLSL declarations: the draw ID attribute, the draw data sampler and
+ * drawModel() and drawMaterial(), which read the current object's data.
+ */
+extern const char *MULTIDRAW_GLSL;
+
+/** Command layout read by glMultiDrawElementsIndirect. */
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/** How the commands are submitted. */
+enum MultiDrawPath
+{
+    /** One glMultiDrawElementsIndirect call. */
+    MULTIDRAW_INDIRECT,
+    /** One glDrawElementsInstancedBaseVertexBaseInstance per command. */
+    MULTIDRAW_BASE_INSTANCE,
+    /** One glDrawElementsInstancedBaseVertex per command, moving the draw ID attribute. */
+    MULTIDRAW_LOOP
+};
+
+/** Name of a submission path. */
+const char *multiDrawPathName(MultiDrawPath path);
+
+/** Counters of the last build() and draw(). */
+struct MultiDrawStats
+{
+    /** Objects added. */
+    unsigned int objects;
+    /** Objects outside the frustum. */
+    unsigned int culled;
+    /** Indirect commands (one per mesh with visible objects). */
+    unsigned int commands;
+    /** GL draw calls of the last draw(). */
+    unsigned int calls;
+};
+
+/** A mesh in the shared buffers. */
+struct PooledMesh
+{
+    /** Ranges in the heap (their offsets are read at build time, so defragmenting is safe). */
+    GpuMesh mesh;
+    /** Bounding sphere in object space. */
+    float center[3];
+    float radius;
+};
+
+/**
+ * Shared mesh buffers and indirect draws.
+ *
+ * Usage: addMesh() for every mesh. Each frame begin(), add() every
+ * object, build(); then draw() once per pass with the pass's program in
+ * use. The draw ID attribute is added to the heap's VAO of the format.
+ */
+class MultiDraw
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param heap Heap holding the meshes.
+     * @param vertexSize Bytes per vertex (the same for all meshes).
+     * @param positionOffset Byte offset of the float position in a vertex.
+     * @param layout Vertex attributes of the format.
+     */
+    MultiDraw(GpuMeshHeap &heap, int vertexSize, int positionOffset, GpuVertexLayoutFunc layout);
+    ~MultiDraw();
+
+    /**
+     * Add a mesh.
+     *
+     * @param vertices Vertex data.
+     * @param vertexCount Number of vertices.
+     * @param indices Triangle list, relative to the mesh's first vertex.
+     * @param indexCount Number of indices.
+     * @return Mesh identifier for add().
+     */
+    int addMesh(const void *vertices, int vertexCount, const unsigned int *indices, int indexCount);
+
+    /**
+     * Replace a mesh's data, keeping its identifier.
+     *
+     * The old ranges are released before the new ones are allocated, so
+     * a smaller mesh reuses them and a larger one leaves a hole that
+     * GpuMeshHeap::defragment() closes.
+     *
+     * @param mesh Mesh identifier from addMesh().
+     * @param vertices Vertex data.
+     * @param vertexCount Number of vertices.
+     * @param indices Triangle list, relative to the mesh's first vertex.
+     * @param indexCount Number of indices.
+     */
+    void replaceMesh(int mesh, const void *vertices, int vertexCount, const unsigned int *indices, int indexCount);
+
+    /** Start a frame. */
+    void begin();
+
+    /**
+     * Add an object.
+     *
+     * @param mesh Mesh identifier.
+     * @param model Model matrix (16 floats, column major).
+     * @param material Material color (4 floats).
+     */
+    void add(int mesh, const float *model, const float *material);
+
+    /**
+     * Cull the objects and build the commands and draw data.
+     *
+     * @param viewProjection View projection matrix (16 floats, column major).
+     */
+    void build(const float *viewProjection);
+
+    /**
+     * Draw the commands of the last build().
+     *
+     * @param program Program in use (its drawData sampler is set to unit).
+     * @param unit Texture unit for the draw data.
+     */
+    void draw(unsigned int program, int unit = 0);
+
+    /** Submission path in use. */
+    MultiDrawPath path() const;
+
+    /** Counters of the last frame. */
+    const MultiDrawStats &stats() const { return lastStats; }
+
+private:
+    /** An object of the current frame. */
+    struct Object
+    {
+        int mesh;
+        float model[16];
+        float material[4];
+    };
+
+    void create();
+    unsigned int vao();
+    void computeBounds(PooledMesh &m, const void *vertices, int vertexCount) const;
+
+    GpuMeshHeap &heap;
+    int format, positionOffset;
+    bool vaoReady;
+    std::vector<PooledMesh> meshes;
+
+    std::vector<Object> objects;
+    std::vector<GLuint> drawIDs;
+    std::vector<DrawElementsIndirectCommand> commands;
+    MultiDrawStats lastStats;
+
+    GLuint idBuffer, dataBuffer, dataTexture, commandBuffer;
+    size_t idCapacity, dataCapacity, commandCapacity;
+};
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * @file particles.cpp
+ * GPU particle system.
+ *
+ * Implements the transform feedback update and the point sprite pass.
+ */
+
+#include <vector>
+#include <stdio.h>
+#include "particles.h"
+#include "utils.h"
+
+
+/** Floats per particle: position (3), velocity (3), remaining life (1). */
+#define PARTICLE_FLOATS 7
+
+
+/** Update shader: spawn, integrate and kill. */
+static const char *update_vertex_code = "\n"
+"#version 330 core\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 1) in vec3 velocity;\n"
+"layout (location = 2) in float life;\n"
+"\n"
+"out vec3 outPosition;\n"
+"out vec3 outVelocity;\n"
+"out float outLife;\n"
+"\n"
+"uniform float dt;\n"
+"uniform float lifetime;\n"
+"uniform int capacity;\n"
+"uniform uint seed;\n"
+"uniform int burstCount;\n"
+"uniform vec4 burstOrigin[8];\n"
+"uniform ivec2 burstRange[8];\n"
+"\n"
+"uint hash(uint x)\n"
+"{\n"
+"    x ^= x >> 16; x *= 0x7feb352du;\n"
+"    x ^= x >> 15; x *= 0x846ca68bu;\n"
+"    x ^= x >> 16;\n"
+"    return x;\n"
+"}\n"
+"\n"
+"float random(inout uint s)\n"
+"{\n"
+"    s = hash(s);\n"
+"    return float(s >> 8) * (1.0 / 16777216.0);\n"
+"}\n"
+"\n"
+"void main()\n"
+"{\n"
+"    vec3 p = position;\n"
+"    vec3 v = velocity;\n"
+"    float l = life;\n"
+"\n"
+"    // Spawn: the slot belongs to a burst of this frame.\n"
+"    for (int b = 0; b < burstCount; b++)\n"
+"    {\n"
+"        int offset = (gl_VertexID - burstRange[b].x + capacity) % capacity;\n"
+"        if (offset < burstRange[b].y)\n"
+"        {\n"
+"            uint s = seed ^ (uint(gl_VertexID) * 0x9e3779b9u);\n"
+"            float z = random(s) * 2.0 - 1.0;\n"
+"            float a = random(s) * 6.2831853;\n"
+"            float r = sqrt(1.0 - z * z);\n"
+"            p = burstOrigin[b].xyz;\n"
+"            v = vec3(r * cos(a), r * sin(a), z) * burstOrigin[b].w * (0.25 + 0.75 * random(s));\n"
+"            l = lifetime * (0.5 + 0.5 * random(s));\n"
+"        }\n"
+"    }\n"
+"\n"
+"    // Integrate live particles; dead ones stay at zero life.\n"
+"    if (l > 0.0)\n"
+"    {\n"
+"        v += vec3(0.0, -2.0, 0.0) * dt;\n"
+"        v *= 1.0 - 0.5 * dt;\n"
+"        p += v * dt;\n"
+"        l -= dt;\n"
+"    }\n"
+"\n"
+"    outPosition = p;\n"
+"    outVelocity = v;\n"
+"    outLife = max(l, 0.0);\n"
+"}\0";
+
+/** Draw vertex shader. */
+static const char *draw_vertex_code = "\n"
+"#version 330 core\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (location = 2) in float life;\n"
+"\n"
+"out float vLife;\n"
+"\n"
+"uniform mat4 viewProjection;\n"
+"uniform float pointSize;\n"
+"uniform float lifetime;\n"
+"\n"
+"void main()\n"
+"{\n"
+"    vLife = life / lifetime;\n"
+"    // Dead particles are moved outside the clip volume.\n"
+"    gl_Position = life > 0.0 ? viewProjection * vec4(position, 1.0) : vec4(2.0, 2.0, 2.0, 1.0);\n"
+"    gl_PointSize = pointSize;\n"
+"}\0";
+
+/** Draw fragment shader. */
+static const char *draw_fragment_code = "\n"
+"#version 330 core\n"
+"\n"
+"in float vLife;\n"
+"\n"
+"out vec4 fragColor;\n"
+"\n"
+"void main()\n"
+"{\n"
+"    vec2 d = gl_PointCoord * 2.0 - 1.0;\n"
+"    float fade = max(1.0 - dot(d, d), 0.0);\n"
+"    vec3 color = mix(vec3(1.0, 0.2, 0.0), vec3(1.0, 1.0, 0.6), vLife);\n"
+"    fragColor = vec4(color * fade * vLife, 1.0);\n"
+"}\0";
+
+
+ParticleSystem::ParticleSystem(int capacity, float lifetime)
+    : capacity(capacity), lifetime(lifetime), current(0),
+      updateProgram(0), drawProgram(0), burstCount(0), cursor(0), seed(1),
+      sinceBurst(1.0e9f), claimed(0)
+{
+    vbo[0] = vbo[1] = 0;
+    vao[0] = vao[1] = 0;
+}
+
+ParticleSystem::~ParticleSystem()
+{
+    if (vbo[0])
+    {
+        glDeleteBuffers(2, vbo);
+        glDeleteVertexArrays(2, vao);
+    }
+}
+
+void ParticleSystem::init()
+{
+    static const char *varyings[] = { "outPosition", "outVelocity", "outLife" };
+    updateProgram = createFeedbackProgram(update_vertex_code, varyings, 3);
+    drawProgram = createShaderProgram(draw_vertex_code, draw_fragment_code);
+
+    // Every slot starts dead (zero life).
+    std::vector<float> zeros((size_t)capacity * PARTICLE_FLOATS, 0.0f);
+
+    glGenBuffers(2, vbo);
+    glGenVertexArrays(2, vao);
+    for (int i = 0; i < 2; i++)
+    {
+        cacheBindVertexArray(vao[i]);
+        cacheBindBuffer(GL_ARRAY_BUFFER, vbo[i]);
+        glBufferData(GL_ARRAY_BUFFER, zeros.size() * sizeof(float), zeros.data(), GL_DYNAMIC_COPY);
+
+        GLsizei stride = PARTICLE_FLOATS * sizeof(float);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+    cacheBindVertexArray(0);
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+}
+
+void ParticleSystem::burst(float x, float y, float z, int count, float speed)
+{
+    if (burstCount == PARTICLE_MAX_BURSTS || count <= 0)
+        return;
+    if (count > capacity)
+        count = capacity;
+
+    // Slots of bursts that have died out are free again.
+    if (sinceBurst > lifetime)
+        claimed = 0;
+
+    Burst &b = bursts[burstCount++];
+    b.origin[0] = x;
+    b.origin[1] = y;
+    b.origin[2] = z;
+    b.speed = speed;
+    b.first = cursor;
+    b.count = count;
+
+    cursor = (cursor + count) % capacity;
+    claimed = claimed + count > capacity ? capacity : claimed + count;
+    sinceBurst = 0.0f;
+}
+
+int ParticleSystem::live() const
+{
+    return sinceBurst > lifetime ? 0 : claimed;
+}
+
+void ParticleSystem::update(float dt)
+{
+    if (!updateProgram)
+        return;
+
+    sinceBurst += dt;
+    if (burstCount == 0 && sinceBurst > lifetime)
+    {
+        // Everything has died out: skip the pass entirely.
+        claimed = 0;
+        return;
+    }
+
+    cacheUseProgram(updateProgram);
+    glUniform1f(glGetUniformLocation(updateProgram, "dt"), dt);
+    glUniform1f(glGetUniformLocation(updateProgram, "lifetime"), lifetime);
+    glUniform1i(glGetUniformLocation(updateProgram, "capacity"), capacity);
+    glUniform1ui(glGetUniformLocation(updateProgram, "seed"), seed);
+    glUniform1i(glGetUniformLocation(updateProgram, "burstCount"), burstCount);
+    for (int b = 0; b < burstCount; b++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "burstOrigin[%d]", b);
+        glUniform4f(glGetUniformLocation(updateProgram, name),
+                    bursts[b].origin[0], bursts[b].origin[1], bursts[b].origin[2], bursts[b].speed);
+        snprintf(name, sizeof(name), "burstRange[%d]", b);
+        glUniform2i(glGetUniformLocation(updateProgram, name), bursts[b].first, bursts[b].count);
+    }
+    burstCount = 0;
+    seed = seed * 1664525u + 1013904223u;
+
+    // Read from the current buffer, capture into the other one.
+    glEnable(GL_RASTERIZER_DISCARD);
+    cacheBindVertexArray(vao[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo[1 - current]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, capacity);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    current = 1 - current;
+}
+
+void ParticleSystem::draw(const float *viewProj, float pointSize)
+{
+    if (!drawProgram || live() == 0)
+        return;
+
+    cacheUseProgram(drawProgram);
+    glUniformMatrix4fv(glGetUniformLocation(drawProgram, "viewProjection"), 1, GL_FALSE, viewProj);
+    glUniform1f(glGetUniformLocation(drawProgram, "pointSize"), pointSize);
+    glUniform1f(glGetUniformLocation(drawProgram, "lifetime"), lifetime);
+
+    // Additive, and without writing depth so particles do not hide each other.
+    cacheEnable(GL_BLEND);
+    cacheBlendFunc(GL_ONE, GL_ONE);
+    cacheDepthMask(GL_FALSE);
+
+    cacheBindVertexArray(vao[current]);
+    glDrawArrays(GL_POINTS, 0, capacity);
+
+    cacheDepthMask(GL_TRUE);
+    cacheDisable(GL_BLEND);
+}
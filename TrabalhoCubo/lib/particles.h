@@ -0,0 +1,104 @@
+/**
+ * @file particles.h
+ * GPU particle system.
+ *
+ * Particles live only in GPU memory. Every frame a vertex shader spawns,
+ * integrates and ages them, writing the result with transform feedback
+ * into a second buffer; the two buffers swap roles each frame (ping-pong).
+ * Requires only OpenGL 3.3.
+ *
+ * Bursts claim consecutive slots of a ring, so spawning needs no readback
+ * of which particles are free: a burst reuses the oldest slots.
+ */
+
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <GL/glew.h>
+
+
+/** Most bursts spawned in one update. */
+#define PARTICLE_MAX_BURSTS 8
+
+/**
+ * Particle system.
+ */
+class ParticleSystem
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param capacity Number of particle slots.
+     * @param lifetime Particle lifetime in seconds.
+     */
+    ParticleSystem(int capacity = 1 << 20, float lifetime = 2.0f);
+    ~ParticleSystem();
+
+    /** Create buffers and programs (needs a GL context). */
+    void init();
+
+    /**
+     * Spawn burst.
+     *
+     * The particles appear on the next update().
+     *
+     * @param x Origin x.
+     * @param y Origin y.
+     * @param z Origin z.
+     * @param count Number of particles.
+     * @param speed Initial speed.
+     */
+    void burst(float x, float y, float z, int count, float speed);
+
+    /**
+     * Simulate.
+     *
+     * Does nothing when no particle can be alive.
+     *
+     * @param dt Time step in seconds.
+     */
+    void update(float dt);
+
+    /**
+     * Draw.
+     *
+     * @param viewProj Projection * view (16 floats, column major).
+     * @param pointSize Point size in pixels.
+     */
+    void draw(const float *viewProj, float pointSize);
+
+    /** Particles possibly alive (upper bound, counted on the CPU). */
+    int live() const;
+
+private:
+    struct Burst
+    {
+        float origin[3];
+        float speed;
+        int first;
+        int count;
+    };
+
+    int capacity;
+    float lifetime;
+
+    unsigned int vbo[2];
+    unsigned int vao[2];
+    int current;
+
+    unsigned int updateProgram;
+    unsigned int drawProgram;
+
+    Burst bursts[PARTICLE_MAX_BURSTS];
+    int burstCount;
+    int cursor;
+    unsigned int seed;
+
+    /** Simulated time since the last burst. */
+    float sinceBurst;
+    /** Slots claimed by bursts within the last lifetime. */
+    int claimed;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file procgeom.cpp
+ * Procedural primitives.
+ *
+ * Implements the shader functions and the shared empty VAO.
+ */
+
+#include <GL/glew.h>
+#include "procgeom.h"
+
+
+const char *PROCGEOM_GLSL = "\n"
+"// Corners of the two triangles of a quad, in (u, v) from 0 to 1.\n"
+"const vec2 procCorners[6] = vec2[6](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),\n"
+"                                    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));\n"
+"\n"
+"void cubeVertex(int id, out vec3 position, out vec3 normal)\n"
+"{\n"
+"    // Faces +x, -x, +y, -y, +z, -z; the tangents u, v satisfy u x v = n.\n"
+"    int face = id / 6;\n"
+"    int axis = face / 2;\n"
+"    float s = (face % 2 == 0) ? 1.0 : -1.0;\n"
+"\n"
+"    vec3 n = vec3(0.0), u = vec3(0.0), v = vec3(0.0);\n"
+"    n[axis] = s;\n"
+"    u[(axis + 1) % 3] = s;\n"
+"    v[(axis + 2) % 3] = 1.0;\n"
+"\n"
+"    vec2 c = procCorners[id % 6] * 2.0 - 1.0;\n"
+"    position = 0.5 * (n + c.x * u + c.y * v);\n"
+"    normal = n;\n"
+"}\n"
+"\n"
+"void quadVertex(int id, out vec3 position, out vec3 normal)\n"
+"{\n"
+"    position = vec3(procCorners[id % 6] - 0.5, 0.0);\n"
+"    normal = vec3(0.0, 0.0, 1.0);\n"
+"}\n"
+"\n"
+"void sphereVertex(int id, int slices, int stacks, out vec3 position, out vec3 normal)\n"
+"{\n"
+"    // Quad (i, j) of the longitude/latitude grid; phi goes from the +y pole down.\n"
+"    int q = id / 6;\n"
+"    vec2 c = vec2(q % slices, q / slices) + procCorners[id % 6];\n"
+"    float theta = 6.28318531 * c.x / float(slices);\n"
+"    float phi = 3.14159265 * c.y / float(stacks);\n"
+"    normal = vec3(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta));\n"
+"    position = 0.5 * normal;\n"
+"}\n";
+
+
+int proceduralVertexCount(ProcPrimitive primitive, int slices, int stacks)
+{
+    switch (primitive)
+    {
+        case PROC_CUBE:   return 36;
+        case PROC_QUAD:   return 6;
+        case PROC_SPHERE: return 6 * slices * stacks;
+    }
+    return 0;
+}
+
+unsigned int proceduralVAO()
+{
+    static unsigned int vao = 0;
+    if (!vao)
+        glGenVertexArrays(1, &vao);
+    return vao;
+}
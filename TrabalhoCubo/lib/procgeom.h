@@ -0,0 +1,54 @@
+/**
+ * @file procgeom.h
+ * Procedural primitives.
+ *
+ * Generates positions and normals of simple primitives in the vertex
+ * shader from gl_VertexID, so they are drawn with an empty VAO and no
+ * vertex buffer at all. Triangles are counter-clockwise seen from outside.
+ *
+ * Vertex shaders include PROCGEOM_GLSL, which defines:
+ *
+ *     void cubeVertex(int id, out vec3 position, out vec3 normal);
+ *     void quadVertex(int id, out vec3 position, out vec3 normal);
+ *     void sphereVertex(int id, int slices, int stacks, out vec3 position, out vec3 normal);
+ *
+ * Cube and quad are unit sized and centered at the origin (the quad lies
+ * in the xy plane facing +z); the sphere has radius 0.5.
+ */
+
+#ifndef PROCGEOM_H
+#define PROCGEOM_H
+
+
+/** Primitives. */
+enum ProcPrimitive
+{
+    PROC_CUBE,
+    PROC_QUAD,
+    PROC_SPHERE
+};
+
+/** GLSL functions generating the primitives. */
+extern const char *PROCGEOM_GLSL;
+
+/**
+ * Vertex count.
+ *
+ * @param primitive Primitive.
+ * @param slices Sphere slices (ignored for other primitives).
+ * @param stacks Sphere stacks (ignored for other primitives).
+ * @return Number of vertices to draw with GL_TRIANGLES.
+ */
+int proceduralVertexCount(ProcPrimitive primitive, int slices = 0, int stacks = 0);
+
+/**
+ * Empty VAO.
+ *
+ * Core profile needs a VAO bound to draw even with no attributes; this one
+ * is shared by all procedural draws.
+ *
+ * @return Vertex array object without vertex attributes.
+ */
+unsigned int proceduralVAO();
+
+#endif
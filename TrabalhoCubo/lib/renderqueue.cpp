@@ -0,0 +1,229 @@
+/**
+ * @file renderqueue.cpp
+ * Render queue.
+ *
+ * Implements draw packet sorting and instanced batching.
+ */
+
+#include <string.h>
+#include "renderqueue.h"
+#include "utils.h"
+#include "framearena.h"
+
+
+RenderQueue::RenderQueue()
+    : instanceVBO(0), instanceCapacity(0), materialFunc(NULL)
+{
+    memset(&lastStats, 0, sizeof(lastStats));
+}
+
+RenderQueue::~RenderQueue()
+{
+    if (instanceVBO)
+        glDeleteBuffers(1, &instanceVBO);
+}
+
+void RenderQueue::setMaterialFunc(RQMaterialFunc func)
+{
+    materialFunc = func;
+}
+
+/**
+ * Build sort key.
+ *
+ * Layout from the most significant bit: program, material, VAO, depth.
+ * Names wider than their field are folded so the key still groups equal
+ * state together.
+ */
+uint64_t RenderQueue::makeKey(unsigned int program, unsigned int material,
+                              unsigned int vao, float depth)
+{
+    const uint64_t depthMax = (1ull << RQ_DEPTH_BITS) - 1;
+
+    if (depth < 0.0f) depth = 0.0f;
+    if (depth > 1.0f) depth = 1.0f;
+
+    uint64_t key = program & ((1u << RQ_PROGRAM_BITS) - 1);
+    key = (key << RQ_MATERIAL_BITS) | (material & ((1u << RQ_MATERIAL_BITS) - 1));
+    key = (key << RQ_VAO_BITS) | (vao & ((1u << RQ_VAO_BITS) - 1));
+    key = (key << RQ_DEPTH_BITS) | (uint64_t)(depth * depthMax);
+
+    return key;
+}
+
+void RenderQueue::submit(unsigned int program, unsigned int material, unsigned int vao,
+                         GLenum mode, GLint first, GLsizei count,
+                         const float *model, float depth)
+{
+    DrawPacket p;
+    p.key      = makeKey(program, material, vao, depth);
+    p.program  = program;
+    p.material = material;
+    p.vao      = vao;
+    p.mode     = mode;
+    p.indexType = 0;
+    p.first    = first;
+    p.count    = count;
+    p.model    = models.size() / 16;
+
+    models.insert(models.end(), model, model + 16);
+    packets.push_back(p);
+}
+
+void RenderQueue::submitIndexed(unsigned int program, unsigned int material, unsigned int vao,
+                                GLenum mode, GLenum indexType, GLint first, GLsizei count,
+                                const float *model, float depth)
+{
+    submit(program, material, vao, mode, first, count, model, depth);
+    packets.back().indexType = indexType;
+}
+
+/** Bytes per index of an index type. */
+static size_t indexSize(GLenum type)
+{
+    return type == GL_UNSIGNED_BYTE ? 1 : (type == GL_UNSIGNED_SHORT ? 2 : 4);
+}
+
+void RenderQueue::radixSort(std::vector<DrawPacket> &packets, DrawPacket *scratch)
+{
+    size_t n = packets.size();
+    if (n < 2)
+        return;
+
+    DrawPacket *src = packets.data();
+    DrawPacket *dst = scratch;
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; i++)
+            count[(src[i].key >> shift) & 0xff]++;
+
+        // All keys share this digit: the pass would not move anything.
+        if (count[(src[0].key >> shift) & 0xff] == n)
+            continue;
+
+        size_t offset = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+
+        for (size_t i = 0; i < n; i++)
+            dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+
+        DrawPacket *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != packets.data())
+        memcpy(packets.data(), src, n * sizeof(DrawPacket));
+}
+
+void RenderQueue::setupInstancing(size_t offset)
+{
+    cacheBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (int c = 0; c < 4; c++)
+    {
+        GLuint loc = RQ_MODEL_LOCATION + c;
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+                              (void *)(offset + c * 4 * sizeof(float)));
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+}
+
+void RenderQueue::flush()
+{
+    memset(&lastStats, 0, sizeof(lastStats));
+    lastStats.draws = packets.size();
+
+    if (packets.empty())
+    {
+        models.clear();
+        return;
+    }
+
+    // Sort scratch and gathered matrices only live until the upload: frame arena.
+    FrameArena &arena = frameArena();
+    radixSort(packets, arena.allocate<DrawPacket>(packets.size()));
+
+    // Gather the model matrices in draw order so each batch is contiguous.
+    float *instances = arena.allocate<float>(models.size());
+    for (size_t i = 0; i < packets.size(); i++)
+        memcpy(&instances[i * 16], &models[packets[i].model * 16], 16 * sizeof(float));
+
+    if (!instanceVBO)
+        glGenBuffers(1, &instanceVBO);
+    cacheBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    size_t bytes = models.size() * sizeof(float);
+    if (bytes > instanceCapacity)
+    {
+        instanceCapacity = bytes * 2;
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances);
+
+    unsigned int curProgram = 0, curMaterial = 0, curVAO = 0;
+    bool first = true;
+
+    size_t i = 0;
+    while (i < packets.size())
+    {
+        const DrawPacket &p = packets[i];
+
+        // Extend the batch over packets drawing the same thing.
+        size_t j = i + 1;
+        while (j < packets.size() &&
+               packets[j].program  == p.program &&
+               packets[j].material == p.material &&
+               packets[j].vao      == p.vao &&
+               packets[j].mode     == p.mode &&
+               packets[j].indexType == p.indexType &&
+               packets[j].first    == p.first &&
+               packets[j].count    == p.count)
+            j++;
+
+        bool programChanged = first || p.program != curProgram;
+        if (programChanged)
+        {
+            cacheUseProgram(p.program);
+            curProgram = p.program;
+            lastStats.stateChanges++;
+        }
+        if (first || p.vao != curVAO)
+        {
+            cacheBindVertexArray(p.vao);
+            curVAO = p.vao;
+            lastStats.stateChanges++;
+        }
+        // Uniforms belong to the program: a new program needs the material again even if it is the same.
+        if (programChanged || p.material != curMaterial)
+        {
+            if (materialFunc)
+                materialFunc(p.program, p.material);
+            curMaterial = p.material;
+            lastStats.stateChanges++;
+        }
+        first = false;
+
+        setupInstancing(i * 16 * sizeof(float));
+        if (p.indexType)
+            glDrawElementsInstanced(p.mode, p.count, p.indexType,
+                                    (void *)(p.first * indexSize(p.indexType)), j - i);
+        else
+            glDrawArraysInstanced(p.mode, p.first, p.count, j - i);
+        lastStats.batches++;
+
+        i = j;
+    }
+
+    // A direct submission binds program, VAO and material for every draw.
+    lastStats.stateChangesAvoided = 3 * lastStats.draws - lastStats.stateChanges;
+
+    packets.clear();
+    models.clear();
+}
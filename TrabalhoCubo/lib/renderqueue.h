@@ -0,0 +1,178 @@
+/**
+ * @file renderqueue.h
+ * Render queue.
+ *
+ * Collects draw packets during a frame, sorts them by a 64-bit state key
+ * and merges packets that share program, material, VAO and geometry into
+ * instanced draws.
+ *
+ * Programs that submit through the queue must read the model matrix as a
+ * per-instance attribute at locations RQ_MODEL_LOCATION to
+ * RQ_MODEL_LOCATION + 3 (a mat4 attribute).
+ */
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <stdint.h>
+#include <vector>
+#include <GL/glew.h>
+
+
+/** First attribute location of the per-instance model matrix. */
+#define RQ_MODEL_LOCATION 3
+
+/** Number of bits of each field of the sort key. */
+#define RQ_PROGRAM_BITS  12
+#define RQ_MATERIAL_BITS 12
+#define RQ_VAO_BITS      16
+#define RQ_DEPTH_BITS    24
+
+/**
+ * Material callback.
+ *
+ * Called by the queue whenever the material or the program changes
+ * between batches (uniforms belong to the program), with the program
+ * already in use.
+ *
+ * @param program Program in use.
+ * @param material Material identifier given on submission.
+ */
+typedef void (*RQMaterialFunc)(unsigned int program, unsigned int material);
+
+/** A single draw request. */
+struct DrawPacket
+{
+    /** Sort key (program, material, VAO, depth). */
+    uint64_t key;
+    /** Program used to draw. */
+    unsigned int program;
+    /** Material identifier. */
+    unsigned int material;
+    /** Vertex array object. */
+    unsigned int vao;
+    /** Primitive type. */
+    GLenum mode;
+    /** Index type (GL_UNSIGNED_INT...), or 0 to draw arrays. */
+    GLenum indexType;
+    /** First vertex, or first index when indexed. */
+    GLint first;
+    /** Number of vertices, or of indices when indexed. */
+    GLsizei count;
+    /** Index into the queue model matrix storage. */
+    unsigned int model;
+};
+
+/** Counters of the last flushed frame. */
+struct RenderQueueStats
+{
+    /** Packets submitted. */
+    unsigned int draws;
+    /** Instanced draws issued to GL. */
+    unsigned int batches;
+    /** Program, material and VAO changes actually made. */
+    unsigned int stateChanges;
+    /** Changes an unsorted, unbatched submission would have made on top. */
+    unsigned int stateChangesAvoided;
+};
+
+/**
+ * Render queue.
+ *
+ * Usage per frame: submit() every object, then flush() once.
+ */
+class RenderQueue
+{
+public:
+    RenderQueue();
+    ~RenderQueue();
+
+    /**
+     * Set material callback.
+     *
+     * @param func Function called when the material or program changes (may be NULL).
+     */
+    void setMaterialFunc(RQMaterialFunc func);
+
+    /**
+     * Submit a draw.
+     *
+     * @param program Program to draw with.
+     * @param material Material identifier.
+     * @param vao Vertex array object.
+     * @param mode Primitive type.
+     * @param first First vertex.
+     * @param count Number of vertices.
+     * @param model Model matrix (16 floats, column major).
+     * @param depth View depth in [0, 1], used to sort front to back.
+     */
+    void submit(unsigned int program, unsigned int material, unsigned int vao,
+                GLenum mode, GLint first, GLsizei count,
+                const float *model, float depth);
+
+    /**
+     * Submit an indexed draw.
+     *
+     * Indices come from the element buffer of the VAO.
+     *
+     * @param program Program to draw with.
+     * @param material Material identifier.
+     * @param vao Vertex array object.
+     * @param mode Primitive type.
+     * @param indexType Index type (GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT).
+     * @param first First index.
+     * @param count Number of indices.
+     * @param model Model matrix (16 floats, column major).
+     * @param depth View depth in [0, 1], used to sort front to back.
+     */
+    void submitIndexed(unsigned int program, unsigned int material, unsigned int vao,
+                       GLenum mode, GLenum indexType, GLint first, GLsizei count,
+                       const float *model, float depth);
+
+    /**
+     * Flush queue.
+     *
+     * Sorts the packets, issues one instanced draw per batch and clears
+     * the queue.
+     */
+    void flush();
+
+    /** Counters of the last flush. */
+    const RenderQueueStats &stats() const { return lastStats; }
+
+    /**
+     * Build sort key.
+     *
+     * @param program Program name.
+     * @param material Material identifier.
+     * @param vao Vertex array object name.
+     * @param depth View depth in [0, 1].
+     * @return Key sorting by program, then material, VAO and depth.
+     */
+    static uint64_t makeKey(unsigned int program, unsigned int material,
+                            unsigned int vao, float depth);
+
+    /**
+     * Radix sort.
+     *
+     * Least significant digit radix sort of the packets by key, 8 bits per
+     * pass. Passes where every key has the same digit are skipped.
+     *
+     * @param packets Packets to sort (sorted in place).
+     * @param scratch Scratch storage for as many packets.
+     */
+    static void radixSort(std::vector<DrawPacket> &packets, DrawPacket *scratch);
+
+private:
+    /** Point the model attributes of the bound VAO at the instance buffer. */
+    void setupInstancing(size_t offset);
+
+    std::vector<DrawPacket> packets;
+    std::vector<float> models;
+    unsigned int instanceVBO;
+    size_t instanceCapacity;
+    RQMaterialFunc materialFunc;
+    RenderQueueStats lastStats;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file scenecache.cpp
+ * Static scene cache.
+ *
+ * Implements the cached framebuffer and its validation.
+ */
+
+#include "scenecache.h"
+#include "utils.h"
+
+
+SceneCache::SceneCache()
+    : fbo(0), color(0), depth(0), width(0), height(0),
+      version(1), cachedVersion(0), valid(false), hitCount(0), missCount(0)
+{
+}
+
+SceneCache::~SceneCache()
+{
+    if (fbo)
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+    }
+}
+
+void SceneCache::allocate(int width, int height)
+{
+    if (!fbo)
+    {
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &color);
+        glGenRenderbuffers(1, &depth);
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR: Scene cache framebuffer incomplete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    this->width = width;
+    this->height = height;
+    valid = false;
+}
+
+bool SceneCache::present(int width, int height)
+{
+    if (width != this->width || height != this->height)
+        allocate(width, height);
+
+    if (!valid || cachedVersion != version)
+    {
+        missCount++;
+        return false;
+    }
+
+    blit();
+    hitCount++;
+    return true;
+}
+
+void SceneCache::begin()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void SceneCache::end()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    blit();
+    cachedVersion = version;
+    valid = true;
+}
+
+void SceneCache::blit()
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
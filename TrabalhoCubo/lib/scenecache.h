@@ -0,0 +1,74 @@
+/**
+ * @file scenecache.h
+ * Static scene cache.
+ *
+ * Keeps the last rendered image of a static scene in a framebuffer object.
+ * While the scene version and the viewport size are unchanged, redisplays
+ * only blit the cached image to the window.
+ */
+
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <GL/glew.h>
+
+
+/**
+ * Scene cache.
+ *
+ * Usage in display():
+ *
+ *     if (cache.present(w, h)) { swap; return; }
+ *     cache.begin();
+ *     ... draw ...
+ *     cache.end();
+ *
+ * Call invalidate() whenever a uniform or the geometry changes.
+ */
+class SceneCache
+{
+public:
+    SceneCache();
+    ~SceneCache();
+
+    /** Scene changed: the next redisplay renders again. */
+    void invalidate() { version++; }
+
+    /**
+     * Present cached image.
+     *
+     * @param width Viewport width.
+     * @param height Viewport height.
+     * @return True if the cached image is current and was blitted.
+     */
+    bool present(int width, int height);
+
+    /** Bind the cache framebuffer to render the scene. */
+    void begin();
+
+    /** Blit the rendered scene to the window and mark it current. */
+    void end();
+
+    /** Number of redisplays served from the cache. */
+    unsigned int hits() const { return hitCount; }
+    /** Number of redisplays that rendered the scene. */
+    unsigned int misses() const { return missCount; }
+
+private:
+    void allocate(int width, int height);
+    void blit();
+
+    unsigned int fbo;
+    unsigned int color;
+    unsigned int depth;
+    int width, height;
+
+    unsigned int version;
+    unsigned int cachedVersion;
+    bool valid;
+
+    unsigned int hitCount;
+    unsigned int missCount;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * @file scheduler.cpp
+ * Frame scheduler.
+ *
+ * Implements frame pacing on top of the GLUT idle callback.
+ */
+
+#include <chrono>
+#include <thread>
+#include <GL/freeglut.h>
+#include "scheduler.h"
+
+
+typedef std::chrono::steady_clock Clock;
+
+/** Below this, waiting spins instead of sleeping (sleep overshoots). */
+static const Clock::duration SPIN_THRESHOLD = std::chrono::microseconds(1000);
+/** Longest single sleep, so input events are still handled promptly. */
+static const Clock::duration MAX_SLEEP = std::chrono::milliseconds(4);
+
+static struct
+{
+    Clock::duration period;
+    Clock::time_point deadline;
+    Clock::time_point lastTick;
+    /** When the pending redisplay was posted. */
+    Clock::time_point postedAt;
+    bool onDemand;
+    bool dirty;
+    bool posted;
+    bool idleSet;
+    SchedulerTick tick;
+} sched;
+
+
+static void schedulerIdle();
+
+/** Register or remove the idle callback. */
+static void schedulerWake(bool wake)
+{
+    if (wake == sched.idleSet)
+        return;
+    glutIdleFunc(wake ? schedulerIdle : NULL);
+    sched.idleSet = wake;
+}
+
+/**
+ * Idle callback.
+ *
+ * Sleeps towards the next deadline in short slices, spins the last
+ * sub-millisecond, then ticks and posts the redisplay.
+ */
+static void schedulerIdle()
+{
+    if (sched.posted)
+    {
+        // Waiting for display(). If it did not come within a period (hidden window, dropped redisplay),
+        // stop waiting and pace the next frame normally instead of polling until it does.
+        if (Clock::now() - sched.postedAt < sched.period)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            return;
+        }
+        sched.posted = false;
+    }
+    if (sched.onDemand && !sched.dirty)
+    {
+        schedulerWake(false);
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    Clock::duration remaining = sched.deadline - now;
+
+    if (remaining > SPIN_THRESHOLD)
+    {
+        Clock::duration sleep = remaining - SPIN_THRESHOLD;
+        std::this_thread::sleep_for(sleep < MAX_SLEEP ? sleep : MAX_SLEEP);
+        return;
+    }
+    while (Clock::now() < sched.deadline)
+        ;
+
+    now = Clock::now();
+    // Fell more than a frame behind (e.g. after blocking): restart pacing.
+    if (now - sched.deadline > sched.period)
+        sched.deadline = now;
+    sched.deadline += sched.period;
+
+    double dt = std::chrono::duration<double>(now - sched.lastTick).count();
+    sched.lastTick = now;
+
+    if (sched.tick && !sched.onDemand)
+        sched.tick(dt);
+
+    sched.posted = true;
+    sched.postedAt = now;
+    glutPostRedisplay();
+}
+
+void schedulerInit(double fps, bool onDemand)
+{
+    schedulerSetRate(fps);
+    sched.deadline = Clock::now();
+    sched.lastTick = sched.deadline;
+    sched.onDemand = onDemand;
+    sched.dirty = true;
+    sched.posted = false;
+    sched.idleSet = false;
+    schedulerWake(true);
+}
+
+void schedulerSetRate(double fps)
+{
+    sched.period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+}
+
+void schedulerSetOnDemand(bool onDemand)
+{
+    sched.onDemand = onDemand;
+    sched.lastTick = Clock::now();
+    schedulerInvalidate();
+}
+
+bool schedulerOnDemand()
+{
+    return sched.onDemand;
+}
+
+void schedulerSetTick(SchedulerTick tick)
+{
+    sched.tick = tick;
+}
+
+void schedulerInvalidate()
+{
+    sched.dirty = true;
+    schedulerWake(true);
+}
+
+void schedulerFrameDone()
+{
+    sched.dirty = false;
+    sched.posted = false;
+}
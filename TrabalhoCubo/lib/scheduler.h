@@ -0,0 +1,65 @@
+/**
+ * @file scheduler.h
+ * Frame scheduler.
+ *
+ * Paces redraws at a target rate without keeping a core busy. Waiting is
+ * done by sleeping, with a spin only for the last fraction of a
+ * millisecond. In on-demand mode, frames are only produced when something
+ * marked the scene dirty, and the GLUT idle callback is removed meanwhile
+ * so the main loop blocks on events.
+ *
+ * The scheduler owns the GLUT idle callback; programs must not register
+ * their own.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+
+/**
+ * Tick function.
+ *
+ * Called once per scheduled frame, before the redisplay is posted.
+ *
+ * @param dt Seconds since the previous tick.
+ */
+typedef void (*SchedulerTick)(double dt);
+
+/**
+ * Init scheduler.
+ *
+ * Must be called after the window is created.
+ *
+ * @param fps Target frame rate.
+ * @param onDemand Only draw when the scene is marked dirty.
+ */
+void schedulerInit(double fps, bool onDemand);
+
+/** Set the target frame rate. */
+void schedulerSetRate(double fps);
+
+/** Set on-demand mode. */
+void schedulerSetOnDemand(bool onDemand);
+
+/** On-demand mode is set. */
+bool schedulerOnDemand();
+
+/** Set the tick function (may be NULL). */
+void schedulerSetTick(SchedulerTick tick);
+
+/**
+ * Mark dirty.
+ *
+ * Requests a frame at the next scheduled time. Needed in on-demand mode
+ * whenever state shown on screen changes.
+ */
+void schedulerInvalidate();
+
+/**
+ * Frame done.
+ *
+ * Called at the end of display().
+ */
+void schedulerFrameDone();
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * @file shaderbatch.cpp
+ * Parallel shader compilation.
+ *
+ * Implements the batched compile, link and completion polling.
+ */
+
+#include <iostream>
+#include "shaderbatch.h"
+
+
+ShaderBatch::ShaderBatch()
+    : linked(false), threadsSet(false)
+{
+}
+
+bool ShaderBatch::parallel() const
+{
+    return GLEW_KHR_parallel_shader_compile;
+}
+
+int ShaderBatch::add(const char *vertex_code, const char *fragment_code)
+{
+    // Let the driver use as many compiler threads as it wants.
+    if (!threadsSet && parallel())
+        glMaxShaderCompilerThreadsKHR(0xffffffffu);
+    threadsSet = true;
+
+    Entry e;
+    e.program = glCreateProgram();
+    e.vertex = glCreateShader(GL_VERTEX_SHADER);
+    e.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+
+    // Sources are copied by glShaderSource, so temporary strings are fine.
+    glShaderSource(e.vertex, 1, &vertex_code, NULL);
+    glShaderSource(e.fragment, 1, &fragment_code, NULL);
+    glCompileShader(e.vertex);
+    glCompileShader(e.fragment);
+    glAttachShader(e.program, e.vertex);
+    glAttachShader(e.program, e.fragment);
+
+    entries.push_back(e);
+    linked = false;
+    return e.program;
+}
+
+void ShaderBatch::link()
+{
+    if (linked)
+        return;
+
+    // No status is queried between the compiles and the links: a query
+    // would wait for that compile to end.
+    for (size_t i = 0; i < entries.size(); i++)
+        glLinkProgram(entries[i].program);
+    linked = true;
+}
+
+bool ShaderBatch::poll()
+{
+    link();
+    if (!parallel())
+        return true;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        GLint done = GL_FALSE;
+        glGetProgramiv(entries[i].program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done)
+            return false;
+    }
+    return true;
+}
+
+bool ShaderBatch::finish()
+{
+    link();
+
+    bool ok = true;
+    char error[512];
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const Entry &e = entries[i];
+        GLint success;
+
+        GLuint shaders[2] = { e.vertex, e.fragment };
+        for (int s = 0; s < 2; s++)
+        {
+            glGetShaderiv(shaders[s], GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shaders[s], sizeof(error), NULL, error);
+                std::cout << "ERROR: Shader compilation error: " << error << std::endl;
+                ok = false;
+            }
+        }
+
+        glGetProgramiv(e.program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(e.program, sizeof(error), NULL, error);
+            std::cout << "ERROR: Program link error: " << error << std::endl;
+            ok = false;
+        }
+
+        glDetachShader(e.program, e.vertex);
+        glDetachShader(e.program, e.fragment);
+        glDeleteShader(e.vertex);
+        glDeleteShader(e.fragment);
+    }
+
+    entries.clear();
+    linked = false;
+    return ok;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file shaderbatch.h
+ * Parallel shader compilation.
+ *
+ * createShaderProgram() compiles, links and checks one program at a time,
+ * so every status query waits for the driver. A ShaderBatch issues the
+ * compiles of all programs first and the links after them, and only
+ * checks the results at the end. With KHR_parallel_shader_compile the
+ * driver compiles on its own threads and poll() asks whether everything
+ * is done without blocking, so the caller can keep loading (or showing
+ * frames) meanwhile. Without the extension poll() cannot ask and reports
+ * done; finish() then waits as createShaderProgram() would.
+ */
+
+#ifndef SHADERBATCH_H
+#define SHADERBATCH_H
+
+#include <vector>
+#include <GL/glew.h>
+
+
+/**
+ * Programs compiled together.
+ *
+ * Program names are returned by add() right away and can be stored, but
+ * must not be used before poll() returned true and finish() was called.
+ */
+class ShaderBatch
+{
+public:
+    ShaderBatch();
+
+    /**
+     * Add a program and start compiling its shaders.
+     *
+     * @param vertex_code Vertex shader source.
+     * @param fragment_code Fragment shader source.
+     * @return Program name.
+     */
+    int add(const char *vertex_code, const char *fragment_code);
+
+    /** Start linking every program added (called by poll() if needed). */
+    void link();
+
+    /**
+     * Check whether every program is compiled and linked.
+     *
+     * Never blocks with KHR_parallel_shader_compile.
+     *
+     * @return true when finish() will not wait.
+     */
+    bool poll();
+
+    /**
+     * Check the results, print the errors and release the shader objects.
+     *
+     * @return true if every program linked.
+     */
+    bool finish();
+
+    /** The driver compiles in parallel (KHR_parallel_shader_compile). */
+    bool parallel() const;
+
+    /** Programs added and not finished. */
+    int pending() const { return entries.size(); }
+
+private:
+    struct Entry
+    {
+        GLuint program, vertex, fragment;
+    };
+
+    std::vector<Entry> entries;
+    bool linked;
+    bool threadsSet;
+};
+
+#endif
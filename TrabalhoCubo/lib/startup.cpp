@@ -0,0 +1,37 @@
+/**
+ * @file startup.cpp
+ * Startup phase profiler.
+ *
+ * Implements the phase marks and the report.
+ */
+
+#include <stdio.h>
+#include "startup.h"
+
+
+StartupProfiler::StartupProfiler()
+    : start(Clock::now()), last(start)
+{
+}
+
+void StartupProfiler::mark(const char *phase)
+{
+    Clock::time_point now = Clock::now();
+    Phase p = { phase, std::chrono::duration<double, std::milli>(now - last).count() };
+    phases.push_back(p);
+    last = now;
+}
+
+double StartupProfiler::total() const
+{
+    return std::chrono::duration<double, std::milli>(last - start).count();
+}
+
+void StartupProfiler::report() const
+{
+    double all = total();
+    printf("startup: %.1f ms\n", all);
+    for (size_t i = 0; i < phases.size(); i++)
+        printf("  %-24s %8.1f ms %5.1f%%\n", phases[i].name, phases[i].ms,
+               all > 0.0 ? 100.0 * phases[i].ms / all : 0.0);
+}
@@ -0,0 +1,55 @@
+/**
+ * @file startup.h
+ * Startup phase profiler.
+ *
+ * Splits the time from program start to the first frame into named
+ * phases (context creation, GLEW, buffer upload, shader compile and link,
+ * first frame) and prints them once, so changes to the startup sequence
+ * can be measured.
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <chrono>
+#include <vector>
+
+
+/**
+ * Wall clock time per startup phase.
+ *
+ * Each mark() closes the phase that began at the previous mark (or at
+ * construction), so a global profiler also counts static initialization.
+ */
+class StartupProfiler
+{
+public:
+    StartupProfiler();
+
+    /**
+     * End a phase.
+     *
+     * @param phase Name of the phase that just ended (not copied).
+     */
+    void mark(const char *phase);
+
+    /** Milliseconds from construction to the last mark. */
+    double total() const;
+
+    /** Print every phase with its share of the total. */
+    void report() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Phase
+    {
+        const char *name;
+        double ms;
+    };
+
+    Clock::time_point start, last;
+    std::vector<Phase> phases;
+};
+
+#endif
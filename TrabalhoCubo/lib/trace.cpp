@@ -0,0 +1,241 @@
+/**
+ * @file trace.cpp
+ * Timeline tracing in the Chrome trace-event format.
+ *
+ * Implements the per-thread rings, the GPU timestamp queries and the
+ * JSON writer.
+ */
+
+#include "trace.h"
+
+#ifdef TRACE_ENABLED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+
+/** A complete event, in nanoseconds on the steady clock. */
+struct TraceEvent
+{
+    const char *name;
+    int64_t start, duration;
+};
+
+/** Ring of one thread (written only by it; never freed, so it can be written after the thread ends). */
+struct TraceBuffer
+{
+    TraceEvent events[TRACE_RING_EVENTS];
+    /** Events recorded so far; published after each event is complete. */
+    std::atomic<uint64_t> head;
+    int tid;
+    const char *name;
+};
+
+/** Events the writer skips at the old end of a ring that may be overwritten meanwhile. */
+#define TRACE_WRITE_MARGIN 256
+
+static std::mutex traceMutex;
+static std::vector<TraceBuffer *> buffers;
+static std::string outputPath = "trace.json";
+static const std::chrono::steady_clock::time_point traceStart = std::chrono::steady_clock::now();
+
+/** Render thread state of the GPU queries. */
+static struct
+{
+    GLuint queries[2 * TRACE_GPU_QUERIES];
+    const char *names[TRACE_GPU_QUERIES];
+    bool pending[TRACE_GPU_QUERIES];
+    bool ended[TRACE_GPU_QUERIES];
+    int next, resolve;
+    /** GPU timestamp minus CPU time, measured once. */
+    int64_t offset;
+    bool ready;
+    TraceBuffer *buffer;
+} gpu;
+
+
+static int64_t traceNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+static TraceBuffer *newBuffer(const char *name)
+{
+    TraceBuffer *b = new TraceBuffer();
+    b->head = 0;
+    b->name = name;
+    std::lock_guard<std::mutex> lock(traceMutex);
+    b->tid = buffers.size();
+    buffers.push_back(b);
+    return b;
+}
+
+static TraceBuffer *threadBuffer()
+{
+    static thread_local TraceBuffer *buffer = NULL;
+    if (!buffer)
+        buffer = newBuffer(NULL);
+    return buffer;
+}
+
+static void record(TraceBuffer *b, const char *name, int64_t start, int64_t duration)
+{
+    uint64_t head = b->head.load(std::memory_order_relaxed);
+    TraceEvent &e = b->events[head % TRACE_RING_EVENTS];
+    e.name = name;
+    e.start = start;
+    e.duration = duration;
+    b->head.store(head + 1, std::memory_order_release);
+}
+
+
+TraceScope::TraceScope(const char *name)
+    : name(name), start(traceNow())
+{
+}
+
+TraceScope::~TraceScope()
+{
+    record(threadBuffer(), name, start, traceNow() - start);
+}
+
+
+TraceGpuScope::TraceGpuScope(const char *name)
+    : slot(-1)
+{
+    if (!gpu.ready)
+    {
+        glGenQueries(2 * TRACE_GPU_QUERIES, gpu.queries);
+        GLint64 now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &now);
+        gpu.offset = now - traceNow();
+        gpu.buffer = newBuffer("GPU");
+        gpu.ready = true;
+    }
+
+    // All pairs in flight: this scope is dropped rather than waited for.
+    if (gpu.pending[gpu.next])
+        return;
+
+    slot = gpu.next;
+    gpu.next = (gpu.next + 1) % TRACE_GPU_QUERIES;
+    gpu.names[slot] = name;
+    gpu.pending[slot] = true;
+    gpu.ended[slot] = false;
+    glQueryCounter(gpu.queries[2 * slot], GL_TIMESTAMP);
+}
+
+TraceGpuScope::~TraceGpuScope()
+{
+    if (slot < 0)
+        return;
+    glQueryCounter(gpu.queries[2 * slot + 1], GL_TIMESTAMP);
+    gpu.ended[slot] = true;
+}
+
+void traceEndFrame()
+{
+    if (!gpu.ready)
+        return;
+
+    // In issue order, stopping at the first result not available yet.
+    while (gpu.pending[gpu.resolve] && gpu.ended[gpu.resolve])
+    {
+        int s = gpu.resolve;
+        GLint available = 0;
+        glGetQueryObjectiv(gpu.queries[2 * s + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(gpu.queries[2 * s], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(gpu.queries[2 * s + 1], GL_QUERY_RESULT, &end);
+        record(gpu.buffer, gpu.names[s], (int64_t)begin - gpu.offset, (int64_t)(end - begin));
+
+        gpu.pending[s] = false;
+        gpu.resolve = (s + 1) % TRACE_GPU_QUERIES;
+    }
+}
+
+void traceThreadName(const char *name)
+{
+    threadBuffer()->name = name;
+}
+
+/** Event name as a JSON string body. */
+static void writeName(FILE *f, const char *name)
+{
+    for (const char *c = name; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', f);
+        fputc(*c, f);
+    }
+}
+
+bool traceWrite()
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    FILE *f = fopen(outputPath.c_str(), "w");
+    if (!f)
+    {
+        printf("ERROR: Could not open trace file %s\n", outputPath.c_str());
+        return false;
+    }
+
+    size_t count = 0;
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        TraceBuffer *b = buffers[i];
+        if (b->name)
+        {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                    first ? "" : ",\n", b->tid);
+            writeName(f, b->name);
+            fprintf(f, "\"}}");
+            first = false;
+        }
+
+        uint64_t head = b->head.load(std::memory_order_acquire);
+        uint64_t keep = TRACE_RING_EVENTS - TRACE_WRITE_MARGIN;
+        for (uint64_t e = head > keep ? head - keep : 0; e < head; e++)
+        {
+            const TraceEvent &ev = b->events[e % TRACE_RING_EVENTS];
+            fprintf(f, "%s{\"name\":\"", first ? "" : ",\n");
+            writeName(f, ev.name);
+            fprintf(f, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", b->tid,
+                    ev.start / 1000.0, ev.duration / 1000.0);
+            first = false;
+            count++;
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+
+    printf("trace: %zu events written to %s\n", count, outputPath.c_str());
+    return true;
+}
+
+static void traceAtExit()
+{
+    traceWrite();
+}
+
+void traceInit(const char *path)
+{
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        outputPath = path;
+    }
+    atexit(traceAtExit);
+}
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file trace.h
+ * Timeline tracing in the Chrome trace-event format.
+ *
+ * TRACE_SCOPE(name) records the time spent in the enclosing block as a
+ * complete event in a ring buffer owned by the calling thread (no locks;
+ * the oldest events are overwritten). TRACE_GPU_SCOPE(name) brackets GPU
+ * work with two GL_TIMESTAMP queries; TRACE_END_FRAME() collects the
+ * results that are available without waiting and puts them on a "GPU"
+ * track, shifted to the CPU clock. TRACE_WRITE() writes every buffer to a
+ * JSON file that chrome://tracing and Perfetto open.
+ *
+ * Tracing is compiled in unless NDEBUG or TRACE_DISABLED is defined; then
+ * every macro expands to nothing and no trace code is built.
+ *
+ * Event names are not copied: they must be string literals (or outlive
+ * the program).
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#if !defined(NDEBUG) && !defined(TRACE_DISABLED)
+#define TRACE_ENABLED 1
+#endif
+
+#ifdef TRACE_ENABLED
+
+#include <stdint.h>
+
+
+/** Events kept per thread. */
+#define TRACE_RING_EVENTS 16384
+
+/** GPU timestamp pairs in flight. */
+#define TRACE_GPU_QUERIES 256
+
+/** Records a block of CPU time on the calling thread's track. */
+class TraceScope
+{
+public:
+    TraceScope(const char *name);
+    ~TraceScope();
+
+private:
+    const char *name;
+    int64_t start;
+};
+
+/** Brackets the GL commands issued in a block with timestamp queries (render thread). */
+class TraceGpuScope
+{
+public:
+    TraceGpuScope(const char *name);
+    ~TraceGpuScope();
+
+private:
+    int slot;
+};
+
+/**
+ * Set the output file.
+ *
+ * The trace is also written when the program exits.
+ *
+ * @param path JSON file.
+ */
+void traceInit(const char *path);
+
+/** Name the calling thread's track (literal). */
+void traceThreadName(const char *name);
+
+/** Collect the finished GPU queries (render thread, once per frame). */
+void traceEndFrame();
+
+/**
+ * Write the trace.
+ *
+ * @return true if the file was written.
+ */
+bool traceWrite();
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_GPU_SCOPE(name) TraceGpuScope TRACE_CONCAT(traceGpuScope, __LINE__)(name)
+#define TRACE_INIT(path) traceInit(path)
+#define TRACE_THREAD_NAME(name) traceThreadName(name)
+#define TRACE_END_FRAME() traceEndFrame()
+#define TRACE_WRITE() traceWrite()
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_GPU_SCOPE(name) ((void)0)
+#define TRACE_INIT(path) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_END_FRAME() ((void)0)
+#define TRACE_WRITE() traceWrite()
+
+/** Nothing to write (a function, so a discarded result does not warn). */
+static inline bool traceWrite()
+{
+    return false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file transform.cpp
+ * Transform hierarchy.
+ *
+ * Implements dirty propagation and world matrix updates.
+ */
+
+#include <assert.h>
+#include "transform.h"
+
+
+/** Node flags. */
+enum
+{
+    /** Local transform changed. */
+    LOCAL_DIRTY = 1,
+    /** World matrix recomputed in the current update (children follow). */
+    WORLD_CHANGED = 2
+};
+
+
+TransformNode TransformHierarchy::create(TransformNode p)
+{
+    assert(p < (int)parent.size());
+
+    parent.push_back(p);
+    translations.push_back(glm::vec3(0.0f));
+    rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    scales.push_back(glm::vec3(1.0f));
+    worlds.push_back(glm::mat4(1.0f));
+    dirty.push_back(LOCAL_DIRTY);
+
+    return (TransformNode)parent.size() - 1;
+}
+
+void TransformHierarchy::setTranslation(TransformNode n, const glm::vec3 &t)
+{
+    translations[n] = t;
+    dirty[n] |= LOCAL_DIRTY;
+}
+
+void TransformHierarchy::setRotation(TransformNode n, const glm::quat &r)
+{
+    rotations[n] = r;
+    dirty[n] |= LOCAL_DIRTY;
+}
+
+void TransformHierarchy::setScale(TransformNode n, const glm::vec3 &s)
+{
+    scales[n] = s;
+    dirty[n] |= LOCAL_DIRTY;
+}
+
+void TransformHierarchy::setEulerDegrees(TransformNode n, const glm::vec3 &degrees)
+{
+    glm::quat rx = glm::angleAxis(glm::radians(degrees.x), glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::quat ry = glm::angleAxis(glm::radians(degrees.y), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::quat rz = glm::angleAxis(glm::radians(degrees.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    setRotation(n, ry * rx * rz);
+}
+
+/**
+ * Update world matrices.
+ *
+ * Parents precede children, so one forward pass sees every parent's final
+ * world matrix before its children. A node is recomputed if its local
+ * transform changed or its parent was recomputed in this pass.
+ */
+int TransformHierarchy::update()
+{
+    int updated = 0;
+    int n = (int)parent.size();
+
+    for (int i = 0; i < n; i++)
+    {
+        int p = parent[i];
+        bool parentChanged = p >= 0 && (dirty[p] & WORLD_CHANGED);
+        if (!(dirty[i] & LOCAL_DIRTY) && !parentChanged)
+            continue;
+
+        // Local T * R * S, built directly instead of multiplying three matrices.
+        glm::mat4 local = glm::mat4_cast(rotations[i]);
+        local[0] *= scales[i].x;
+        local[1] *= scales[i].y;
+        local[2] *= scales[i].z;
+        local[3] = glm::vec4(translations[i], 1.0f);
+
+        worlds[i] = p >= 0 ? worlds[p] * local : local;
+        dirty[i] = WORLD_CHANGED;
+        updated++;
+    }
+
+    // Clear the changed marks for the next update.
+    for (int i = 0; i < n; i++)
+        dirty[i] &= LOCAL_DIRTY;
+
+    return updated;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file transform.h
+ * Transform hierarchy.
+ *
+ * Stores nodes with a parent link and a decomposed local transform
+ * (translation, rotation, scale) in flat arrays ordered so that every
+ * parent comes before its children. update() recomputes world matrices
+ * only for nodes that changed and for their descendants.
+ */
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+
+/** Index of a node; -1 means no node. */
+typedef int TransformNode;
+
+/**
+ * Transform hierarchy.
+ */
+class TransformHierarchy
+{
+public:
+    /**
+     * Create node.
+     *
+     * The parent must already exist, which keeps parents ahead of their
+     * children in the arrays.
+     *
+     * @param parent Parent node or -1 for a root.
+     * @return New node.
+     */
+    TransformNode create(TransformNode parent = -1);
+
+    /** Number of nodes. */
+    int size() const { return (int)parent.size(); }
+
+    /** Set local translation. */
+    void setTranslation(TransformNode n, const glm::vec3 &t);
+    /** Set local rotation. */
+    void setRotation(TransformNode n, const glm::quat &r);
+    /** Set local scale. */
+    void setScale(TransformNode n, const glm::vec3 &s);
+
+    /**
+     * Set local rotation from Euler angles.
+     *
+     * Composed as Ry * Rx * Rz, the order used by the cube program.
+     *
+     * @param n Node.
+     * @param degrees Angles around x, y and z in degrees.
+     */
+    void setEulerDegrees(TransformNode n, const glm::vec3 &degrees);
+
+    const glm::vec3 &translation(TransformNode n) const { return translations[n]; }
+    const glm::quat &rotation(TransformNode n) const { return rotations[n]; }
+    const glm::vec3 &scale(TransformNode n) const { return scales[n]; }
+
+    /**
+     * Update world matrices.
+     *
+     * @return Number of world matrices recomputed.
+     */
+    int update();
+
+    /** World matrix of a node (valid after update()). */
+    const glm::mat4 &world(TransformNode n) const { return worlds[n]; }
+
+    /** All world matrices, in node order. */
+    const glm::mat4 *worldMatrices() const { return worlds.data(); }
+
+private:
+    std::vector<TransformNode> parent;
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worlds;
+    std::vector<unsigned char> dirty;
+};
+
+#endif
@@ -40,7 +40,7 @@
      if (!success)
      {
      glGetShaderInfoLog(vertex, 512, NULL, error);
-     std::cout << "ERROR: Shader comilation error: " << error << std::endl;
+     std::cout << "ERROR: Shader compilation error: " << error << std::endl;
      }
                  
      glCompileShader(fragment);
@@ -48,7 +48,7 @@
      if (!success)
      {
      glGetShaderInfoLog(fragment, 512, NULL, error);
-     std::cout << "ERROR: Shader comilation error: " << error << std::endl;
+     std::cout << "ERROR: Shader compilation error: " << error << std::endl;
      }
  
      // Attach shader objects to the program
@@ -57,7 +57,7 @@
  
      // Build program
      glLinkProgram(program);
-     glGetShaderiv(program, GL_LINK_STATUS, &success);
+     glGetProgramiv(program, GL_LINK_STATUS, &success);
      if (!success)
      {
      glGetProgramInfoLog(program, 512, NULL, error);
@@ -72,4 +72,291 @@
  
      return program;
  }
- 
\ No newline at end of file
+ 
+
+ /** 
+  * Create transform feedback program.
+  *
+  * Creates a vertex-only program whose outputs are captured with transform
+  * feedback (interleaved, in the given order).
+  *
+  * @param vertex_code String with code for vertex shader.
+  * @param varyings Names of the captured outputs.
+  * @param count Number of captured outputs.
+  * @return Compiled program.
+  */
+ int createFeedbackProgram(const char *vertex_code, const char **varyings, int count)
+ {
+     int success;
+     char error[512];
+
+     int program = glCreateProgram();
+     int vertex  = glCreateShader(GL_VERTEX_SHADER);
+
+     glShaderSource(vertex, 1, &vertex_code, NULL);
+     glCompileShader(vertex);
+     glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+     if (!success)
+     {
+     glGetShaderInfoLog(vertex, 512, NULL, error);
+     std::cout << "ERROR: Shader compilation error: " << error << std::endl;
+     }
+
+     glAttachShader(program, vertex);
+
+     // Captured outputs must be declared before linking
+     glTransformFeedbackVaryings(program, count, varyings, GL_INTERLEAVED_ATTRIBS);
+     glLinkProgram(program);
+     glGetProgramiv(program, GL_LINK_STATUS, &success);
+     if (!success)
+     {
+     glGetProgramInfoLog(program, 512, NULL, error);
+     std::cout << "ERROR: Program link error: " << error << std::endl;
+     }
+
+     glDetachShader(program, vertex);
+     glDeleteShader(vertex);
+
+     return program;
+ }
+
+
+ /* GL state cache. */
+
+ /** Number of texture units shadowed. */
+ #define CACHE_TEXTURE_UNITS 16
+ /** Number of texture targets shadowed per unit. */
+ #define CACHE_TEXTURE_TARGETS 4
+ /** Number of buffer targets shadowed. */
+ #define CACHE_BUFFER_TARGETS 5
+ /** Number of capabilities shadowed. */
+ #define CACHE_CAPS 4
+
+ /** Value meaning "unknown" for shadowed state. */
+ static const unsigned int UNKNOWN = 0xffffffffu;
+
+ static const GLenum textureTargets[CACHE_TEXTURE_TARGETS] = {
+     GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY
+ };
+ static const GLenum bufferTargets[CACHE_BUFFER_TARGETS] = {
+     GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+     GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER
+ };
+ static const GLenum caps[CACHE_CAPS] = {
+     GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST
+ };
+
+ /** Shadowed state. */
+ static struct
+ {
+     unsigned int program;
+     unsigned int vao;
+     unsigned int buffers[CACHE_BUFFER_TARGETS];
+     unsigned int activeUnit;
+     unsigned int textures[CACHE_TEXTURE_UNITS][CACHE_TEXTURE_TARGETS];
+     unsigned int caps[CACHE_CAPS];
+     unsigned int blendSrc, blendDst;
+     unsigned int depthFunc;
+     unsigned int depthMask;
+     float clearColor[4];
+     bool clearColorKnown;
+ } cache = {
+     UNKNOWN, UNKNOWN,
+     {UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN},
+     UNKNOWN,
+     {},
+     {UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN},
+     UNKNOWN, UNKNOWN,
+     UNKNOWN,
+     UNKNOWN,
+     {0.0f, 0.0f, 0.0f, 0.0f},
+     false
+ };
+
+ static bool cacheTexturesKnown = false;
+ static StateCacheStats cacheCurrent = {0, 0};
+ static StateCacheStats cacheLast = {0, 0};
+
+
+ /**
+  * Compare and store.
+  *
+  * @param slot Shadowed value.
+  * @param value New value.
+  * @return True if the call must reach GL.
+  */
+ static bool cacheSet(unsigned int &slot, unsigned int value)
+ {
+     if (slot == value)
+     {
+     cacheCurrent.elided++;
+     return false;
+     }
+     slot = value;
+     cacheCurrent.issued++;
+     return true;
+ }
+
+ static int cacheIndex(const GLenum *list, int n, GLenum value)
+ {
+     for (int i = 0; i < n; i++)
+         if (list[i] == value)
+             return i;
+     return -1;
+ }
+
+ void cacheUseProgram(unsigned int program)
+ {
+     if (cacheSet(cache.program, program))
+         glUseProgram(program);
+ }
+
+ void cacheBindVertexArray(unsigned int vao)
+ {
+     if (cacheSet(cache.vao, vao))
+     {
+     glBindVertexArray(vao);
+     // The element buffer binding is part of the VAO state.
+     cache.buffers[1] = UNKNOWN;
+     }
+ }
+
+ void cacheBindBuffer(GLenum target, unsigned int buffer)
+ {
+     int i = cacheIndex(bufferTargets, CACHE_BUFFER_TARGETS, target);
+     if (i < 0)
+     {
+     cacheCurrent.issued++;
+     glBindBuffer(target, buffer);
+     return;
+     }
+     if (cacheSet(cache.buffers[i], buffer))
+         glBindBuffer(target, buffer);
+ }
+
+ void cacheBindTexture(unsigned int unit, GLenum target, unsigned int texture)
+ {
+     if (!cacheTexturesKnown)
+     {
+     for (int u = 0; u < CACHE_TEXTURE_UNITS; u++)
+         for (int t = 0; t < CACHE_TEXTURE_TARGETS; t++)
+             cache.textures[u][t] = UNKNOWN;
+     cacheTexturesKnown = true;
+     }
+
+     int t = cacheIndex(textureTargets, CACHE_TEXTURE_TARGETS, target);
+     if (t < 0 || unit >= CACHE_TEXTURE_UNITS)
+     {
+     if (cacheSet(cache.activeUnit, unit))
+         glActiveTexture(GL_TEXTURE0 + unit);
+     cacheCurrent.issued++;
+     glBindTexture(target, texture);
+     return;
+     }
+
+     if (cache.textures[unit][t] == texture)
+     {
+     cacheCurrent.elided++;
+     return;
+     }
+     if (cacheSet(cache.activeUnit, unit))
+         glActiveTexture(GL_TEXTURE0 + unit);
+     cache.textures[unit][t] = texture;
+     cacheCurrent.issued++;
+     glBindTexture(target, texture);
+ }
+
+ void cacheEnable(GLenum cap)
+ {
+     int i = cacheIndex(caps, CACHE_CAPS, cap);
+     if (i < 0)
+     {
+     cacheCurrent.issued++;
+     glEnable(cap);
+     }
+     else if (cacheSet(cache.caps[i], 1))
+         glEnable(cap);
+ }
+
+ void cacheDisable(GLenum cap)
+ {
+     int i = cacheIndex(caps, CACHE_CAPS, cap);
+     if (i < 0)
+     {
+     cacheCurrent.issued++;
+     glDisable(cap);
+     }
+     else if (cacheSet(cache.caps[i], 0))
+         glDisable(cap);
+ }
+
+ void cacheBlendFunc(GLenum sfactor, GLenum dfactor)
+ {
+     if (cache.blendSrc == sfactor && cache.blendDst == dfactor)
+     {
+     cacheCurrent.elided++;
+     return;
+     }
+     cache.blendSrc = sfactor;
+     cache.blendDst = dfactor;
+     cacheCurrent.issued++;
+     glBlendFunc(sfactor, dfactor);
+ }
+
+ void cacheDepthFunc(GLenum func)
+ {
+     if (cacheSet(cache.depthFunc, func))
+         glDepthFunc(func);
+ }
+
+ void cacheDepthMask(GLboolean flag)
+ {
+     if (cacheSet(cache.depthMask, flag))
+         glDepthMask(flag);
+ }
+
+ void cacheClearColor(float r, float g, float b, float a)
+ {
+     if (cache.clearColorKnown &&
+         cache.clearColor[0] == r && cache.clearColor[1] == g &&
+         cache.clearColor[2] == b && cache.clearColor[3] == a)
+     {
+     cacheCurrent.elided++;
+     return;
+     }
+     cache.clearColor[0] = r;
+     cache.clearColor[1] = g;
+     cache.clearColor[2] = b;
+     cache.clearColor[3] = a;
+     cache.clearColorKnown = true;
+     cacheCurrent.issued++;
+     glClearColor(r, g, b, a);
+ }
+
+ void cacheInvalidate()
+ {
+     cache.program = UNKNOWN;
+     cache.vao = UNKNOWN;
+     for (int i = 0; i < CACHE_BUFFER_TARGETS; i++)
+         cache.buffers[i] = UNKNOWN;
+     cache.activeUnit = UNKNOWN;
+     cacheTexturesKnown = false;
+     for (int i = 0; i < CACHE_CAPS; i++)
+         cache.caps[i] = UNKNOWN;
+     cache.blendSrc = cache.blendDst = UNKNOWN;
+     cache.depthFunc = UNKNOWN;
+     cache.depthMask = UNKNOWN;
+     cache.clearColorKnown = false;
+ }
+
+ void cacheEndFrame()
+ {
+     cacheLast = cacheCurrent;
+     cacheCurrent.issued = 0;
+     cacheCurrent.elided = 0;
+ }
+
+ StateCacheStats cacheFrameStats()
+ {
+     return cacheLast;
+ }
@@ -7,6 +7,9 @@
  * @author Ricardo Dutra da Silva
  */
 
+#ifndef UTILS_H
+#define UTILS_H
+
 #include <iostream>
 #include <GL/glew.h>
 #include <GL/freeglut.h>
@@ -23,3 +26,81 @@
  */
 int createShaderProgram(const char *, const char *);
 
+/**
+ * Create transform feedback program.
+ *
+ * Creates a vertex-only program whose outputs are captured with transform
+ * feedback (interleaved, in the given order).
+ *
+ * @param vertex_code String with code for vertex shader.
+ * @param varyings Names of the captured outputs.
+ * @param count Number of captured outputs.
+ * @return Compiled program.
+ */
+int createFeedbackProgram(const char *, const char **, int);
+
+
+/**
+ * @name GL state cache.
+ *
+ * Shadows the GL state most often re-set by display() and skips calls that
+ * would not change it. All GL state these functions cover must be changed
+ * through them, or cacheInvalidate() must be called afterwards.
+ */
+/**@{*/
+
+/** Counters of the state cache. */
+struct StateCacheStats
+{
+    /** Calls forwarded to GL. */
+    unsigned int issued;
+    /** Calls skipped because the state was already set. */
+    unsigned int elided;
+};
+
+/** Cached glUseProgram. */
+void cacheUseProgram(unsigned int program);
+/** Cached glBindVertexArray. Also forgets the element buffer binding. */
+void cacheBindVertexArray(unsigned int vao);
+/** Cached glBindBuffer (array, element, uniform, pixel pack/unpack targets). */
+void cacheBindBuffer(GLenum target, unsigned int buffer);
+/** Cached glActiveTexture + glBindTexture (2D, 3D, cube map, 2D array). */
+void cacheBindTexture(unsigned int unit, GLenum target, unsigned int texture);
+/** Cached glEnable (blend, depth test, cull face, scissor test). */
+void cacheEnable(GLenum cap);
+/** Cached glDisable (blend, depth test, cull face, scissor test). */
+void cacheDisable(GLenum cap);
+/** Cached glBlendFunc. */
+void cacheBlendFunc(GLenum sfactor, GLenum dfactor);
+/** Cached glDepthFunc. */
+void cacheDepthFunc(GLenum func);
+/** Cached glDepthMask. */
+void cacheDepthMask(GLboolean flag);
+/** Cached glClearColor. */
+void cacheClearColor(float r, float g, float b, float a);
+
+/**
+ * Invalidate cache.
+ *
+ * Forgets every shadowed value so the next call of each kind reaches GL.
+ * Use after code that changes state without going through the cache.
+ */
+void cacheInvalidate();
+
+/**
+ * End frame.
+ *
+ * Stores the counters of the frame that just ended and zeroes them.
+ */
+void cacheEndFrame();
+
+/**
+ * Frame counters.
+ *
+ * @return Counters of the last frame ended with cacheEndFrame().
+ */
+StateCacheStats cacheFrameStats();
+
+/**@}*/
+
+#endif
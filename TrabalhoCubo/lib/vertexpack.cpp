@@ -0,0 +1,219 @@
+/**
+ * @file vertexpack.cpp
+ * Packed vertex formats.
+ *
+ * Implements the converter and the attribute setup.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <GL/glew.h>
+#include "vertexpack.h"
+
+
+const char *VERTEXPACK_GLSL = "\n"
+"uniform vec4 dequant;\n"
+"\n"
+"vec3 unpackPosition(vec3 q)\n"
+"{\n"
+"    return dequant.xyz + dequant.w * q;\n"
+"}\n";
+
+
+uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t exponent = (x >> 23) & 0xff;
+    uint32_t mantissa = x & 0x7fffff;
+
+    // Infinity and NaN (keeping NaN quiet).
+    if (exponent == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 | (mantissa >> 13) : 0);
+
+    int e = (int)exponent - 127 + 15;
+    if (e >= 31)
+        return sign | 0x7c00;
+
+    uint32_t h, rest, half;
+    if (e <= 0)
+    {
+        // Subnormal half (or zero): shift the mantissa with its implicit bit.
+        if (e < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - e;
+        h = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        half = 1u << (shift - 1);
+    }
+    else
+    {
+        h = ((uint32_t)e << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fff;
+        half = 0x1000;
+    }
+
+    // Round to nearest even; a carry into the exponent is still correct.
+    if (rest > half || (rest == half && (h & 1)))
+        h++;
+    return sign | h;
+}
+
+/** Float in [-1, 1] to a signed normalized integer with the given largest value. */
+static int snorm(float v, int largest)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int)lrintf(v * largest);
+}
+
+/** Float in [0, 1] to an 8-bit unsigned normalized integer. */
+static uint8_t unorm8(float v)
+{
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint8_t)lrintf(v * 255.0f);
+}
+
+PackedVertices packVertices(int count, int stride, const float *positions, const float *normals,
+                            const float *colors, const VertexPackFormat &format)
+{
+    PackedVertices out;
+    out.format = format;
+    out.count = count;
+
+    // Layout: position, normal, color; every attribute is 4-byte aligned.
+    out.positionOffset = 0;
+    out.stride = format.position == POSITION_FLOAT ? 12 : 8;
+    out.normalOffset = normals ? out.stride : -1;
+    if (normals)
+        out.stride += format.packNormal ? 4 : 12;
+    out.colorOffset = colors ? out.stride : -1;
+    if (colors)
+        out.stride += format.packColor ? 4 : 12;
+
+    // Quantized positions are mapped from the bounds into [-1, 1].
+    out.dequant[0] = out.dequant[1] = out.dequant[2] = 0.0f;
+    out.dequant[3] = 1.0f;
+    if (format.position != POSITION_FLOAT && count > 0)
+    {
+        float lo[3], hi[3];
+        for (int k = 0; k < 3; k++)
+            lo[k] = hi[k] = positions[k];
+        for (int i = 1; i < count; i++)
+            for (int k = 0; k < 3; k++)
+            {
+                float p = positions[i * stride + k];
+                lo[k] = p < lo[k] ? p : lo[k];
+                hi[k] = p > hi[k] ? p : hi[k];
+            }
+
+        float extent = 0.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            out.dequant[k] = 0.5f * (lo[k] + hi[k]);
+            extent = fmaxf(extent, 0.5f * (hi[k] - lo[k]));
+        }
+        out.dequant[3] = extent > 0.0f ? extent : 1.0f;
+    }
+
+    out.data.assign((size_t)count * out.stride, 0);
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t *v = &out.data[(size_t)i * out.stride];
+        const float *p = positions + i * stride;
+
+        if (format.position == POSITION_FLOAT)
+            memcpy(v, p, 3 * sizeof(float));
+        else
+        {
+            uint16_t q[4] = { 0, 0, 0, 0 };
+            for (int k = 0; k < 3; k++)
+            {
+                float t = (p[k] - out.dequant[k]) / out.dequant[3];
+                if (format.position == POSITION_HALF)
+                    q[k] = floatToHalf(t);
+                else
+                    q[k] = (uint16_t)(int16_t)snorm(t, 32767);
+            }
+            memcpy(v, q, sizeof(q));
+        }
+
+        if (normals)
+        {
+            const float *n = normals + i * stride;
+            if (format.packNormal)
+            {
+                uint32_t packed = ((uint32_t)snorm(n[0], 511) & 0x3ff) |
+                                  (((uint32_t)snorm(n[1], 511) & 0x3ff) << 10) |
+                                  (((uint32_t)snorm(n[2], 511) & 0x3ff) << 20);
+                memcpy(v + out.normalOffset, &packed, sizeof(packed));
+            }
+            else
+                memcpy(v + out.normalOffset, n, 3 * sizeof(float));
+        }
+
+        if (colors)
+        {
+            const float *c = colors + i * stride;
+            if (format.packColor)
+            {
+                uint8_t rgba[4] = { unorm8(c[0]), unorm8(c[1]), unorm8(c[2]), 255 };
+                memcpy(v + out.colorOffset, rgba, sizeof(rgba));
+            }
+            else
+                memcpy(v + out.colorOffset, c, 3 * sizeof(float));
+        }
+    }
+    return out;
+}
+
+void packedVertexAttributes(const PackedVertices &vertices, int positionLocation, int normalLocation,
+                            int colorLocation)
+{
+    const VertexPackFormat &f = vertices.format;
+    GLsizei stride = vertices.stride;
+
+    if (positionLocation >= 0)
+    {
+        void *offset = (void *)(size_t)vertices.positionOffset;
+        if (f.position == POSITION_HALF)
+            glVertexAttribPointer(positionLocation, 3, GL_HALF_FLOAT, GL_FALSE, stride, offset);
+        else if (f.position == POSITION_SNORM16)
+            glVertexAttribPointer(positionLocation, 3, GL_SHORT, GL_TRUE, stride, offset);
+        else
+            glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, stride, offset);
+        glEnableVertexAttribArray(positionLocation);
+    }
+
+    if (normalLocation >= 0 && vertices.normalOffset >= 0)
+    {
+        void *offset = (void *)(size_t)vertices.normalOffset;
+        if (f.packNormal)
+            glVertexAttribPointer(normalLocation, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, offset);
+        else
+            glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, stride, offset);
+        glEnableVertexAttribArray(normalLocation);
+    }
+
+    if (colorLocation >= 0 && vertices.colorOffset >= 0)
+    {
+        void *offset = (void *)(size_t)vertices.colorOffset;
+        if (f.packColor)
+            glVertexAttribPointer(colorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, offset);
+        else
+            glVertexAttribPointer(colorLocation, 3, GL_FLOAT, GL_FALSE, stride, offset);
+        glEnableVertexAttribArray(colorLocation);
+    }
+}
+
+const char *positionEncodingName(PositionEncoding encoding)
+{
+    switch (encoding)
+    {
+        case POSITION_HALF:    return "half";
+        case POSITION_SNORM16: return "snorm16";
+        default:               return "float";
+    }
+}
@@ -0,0 +1,117 @@
+/**
+ * @file vertexpack.h
+ * Packed vertex formats.
+ *
+ * Converts float vertices (position, normal, color) into compact layouts:
+ * positions as half floats or normalized shorts, normals as
+ * GL_INT_2_10_10_10_REV and colors as 8-bit RGBA. A position, normal and
+ * color vertex goes from 36 bytes to 16, and a position and normal vertex
+ * from 24 bytes to 12.
+ *
+ * Quantized positions are relative to the mesh bounds: the converter maps
+ * the mesh into [-1, 1] with an offset and a single scale, and vertex
+ * shaders include VERTEXPACK_GLSL and call unpackPosition() to undo it. The
+ * scale is the same on every axis so normals need no correction. Normals
+ * and colors are decoded by the fetch hardware (normalized attributes);
+ * shaders only renormalize the normal as they already do.
+ */
+
+#ifndef VERTEXPACK_H
+#define VERTEXPACK_H
+
+#include <stdint.h>
+#include <vector>
+
+
+/** Position encodings. */
+enum PositionEncoding
+{
+    /** Three floats (12 bytes). */
+    POSITION_FLOAT,
+    /** Three half floats and padding (8 bytes). */
+    POSITION_HALF,
+    /** Three normalized shorts and padding (8 bytes). */
+    POSITION_SNORM16
+};
+
+/** Vertex layout. */
+struct VertexPackFormat
+{
+    /** Position encoding. */
+    PositionEncoding position;
+    /** Normals as 10:10:10:2 (4 bytes) instead of three floats. */
+    bool packNormal;
+    /** Colors as 8-bit RGBA (4 bytes) instead of three floats. */
+    bool packColor;
+};
+
+/** Converted vertices. */
+struct PackedVertices
+{
+    /** Interleaved vertex data. */
+    std::vector<uint8_t> data;
+    /** Layout. */
+    VertexPackFormat format;
+    /** Bytes per vertex. */
+    int stride;
+    /** Byte offsets in the vertex; -1 when the attribute is absent. */
+    int positionOffset, normalOffset, colorOffset;
+    /** Dequantization (offset x, y, z and scale) for unpackPosition(). */
+    float dequant[4];
+    /** Number of vertices. */
+    int count;
+};
+
+/**
+ * GLSL decode function.
+ *
+ * Declares the uniform vec4 dequant and vec3 unpackPosition(vec3 q),
+ * returning dequant.xyz + dequant.w * q.
+ */
+extern const char *VERTEXPACK_GLSL;
+
+/**
+ * Convert vertices.
+ *
+ * Inputs are float arrays with the given stride, so they may point into an
+ * interleaved array.
+ *
+ * @param count Number of vertices.
+ * @param stride Floats between consecutive vertices.
+ * @param positions First position (x, y, z).
+ * @param normals First normal, or NULL.
+ * @param colors First color (r, g, b in [0, 1]), or NULL.
+ * @param format Target layout.
+ * @return Packed vertices.
+ */
+PackedVertices packVertices(int count, int stride, const float *positions, const float *normals,
+                            const float *colors, const VertexPackFormat &format);
+
+/**
+ * Bind attributes.
+ *
+ * Points the attributes of the bound vertex array object at the bound
+ * GL_ARRAY_BUFFER holding the packed data. Absent attributes are skipped.
+ *
+ * @param vertices Packed vertices.
+ * @param positionLocation Position attribute location.
+ * @param normalLocation Normal attribute location.
+ * @param colorLocation Color attribute location.
+ */
+void packedVertexAttributes(const PackedVertices &vertices, int positionLocation, int normalLocation,
+                            int colorLocation);
+
+/**
+ * Convert to half float.
+ *
+ * Rounds to nearest even; overflows to infinity and keeps NaN.
+ *
+ * @param f Value.
+ * @return IEEE 754 binary16 bits.
+ */
+uint16_t floatToHalf(float f);
+
+/** Name of a position encoding. */
+const char *positionEncodingName(PositionEncoding encoding);
+
+#endif
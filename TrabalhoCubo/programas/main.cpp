@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 #include <glm/glm.hpp>
@@ -7,14 +9,76 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include "../lib/utils.h"
+#include "../lib/renderqueue.h"
+#include "../lib/capture.h"
+#include "../lib/dynres.h"
+#include "../lib/scheduler.h"
+#include "../lib/transform.h"
+#include "../lib/matbatch.h"
+#include "../lib/particles.h"
+#include "../lib/gpuanim.h"
+#include "../lib/procgeom.h"
+#include "../lib/meshgen.h"
+#include "../lib/vertexpack.h"
+#include "../lib/meshopt.h"
+#include "../lib/meshlet.h"
+#include "../lib/meshcheck.h"
+#include "../lib/depthprepass.h"
+#include "../lib/gpuheap.h"
+#include "../lib/multidraw.h"
+#include "../lib/shaderbatch.h"
+#include "../lib/startup.h"
+#include "../lib/assetloader.h"
+#include "../lib/framearena.h"
+#include "../lib/trace.h"
+#include "../lib/gldebug.h"
+#include "../lib/frameaudit.h"
 
 // Tamanho inicial da janela
 int win_width = 800;
 int win_height = 600;
 
+// Formato dos vértices do cubo: posição, cor e normal (locais 0, 1 e 2 do shader)
+struct VerticeCubo
+{
+    float position[3];
+    float color[3];
+    float normal[3];
+
+    // Converte um vértice gerado pela meshgen. A cor depende só do canto: cantos opostos têm a mesma
+    // cor (vermelho, verde, azul ou amarelo), como no cubo digitado originalmente
+    static constexpr VerticeCubo make(const MeshAttributes &a)
+    {
+        VerticeCubo v{};
+        bool x = (a.position[0] > 0) == (a.position[2] > 0);
+        bool y = (a.position[1] > 0) == (a.position[2] > 0);
+        // (x, y): (não, não) vermelho, (sim, não) verde, (sim, sim) azul, (não, sim) amarelo
+        v.color[0] = (!x) ? 1.0f : 0.0f;
+        v.color[1] = (x != y) ? 1.0f : 0.0f;
+        v.color[2] = (x && y) ? 1.0f : 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            v.position[i] = a.position[i];
+            v.normal[i] = a.normal[i];
+        }
+        return v;
+    }
+};
+
 int program;
 unsigned int VAO1; // Vertex Array Object
 unsigned int VBO1;
+unsigned int EBO1; // Element Buffer Object (índices do cubo)
+// Fila de desenho: ordena os pacotes por estado e agrupa em desenhos instanciados
+RenderQueue queue;
+// Gravação dos frames em disco (leitura assíncrona via PBO)
+FrameCapture capture;
+// Arquivo (ou padrão com o número do frame) usado pela gravação
+const char *capturePath = "captura_%05d.ppm";
+// Resolução dinâmica: renderiza fora da tela numa resolução que mantém o tempo de frame em ~16 ms
+DynamicResolution dynres(16.0f);
+// Usa o filtro de ampliação com nitidez
+bool nitidez = false;
 // Controla se a escala vai aumentar ou diminuir após a colisão
 bool aumentarEscala = true;
 
@@ -51,30 +115,250 @@ glm::vec2 pos = glm::vec2(0.0f, 0.0f);    // posição do objeto
 glm::vec2 vel = glm::vec2(0.01f, 0.012f); // velocidade (x, y)
 float objeto_size = 0.2f;                 // "20% do tamanho" do objeto
 
+// Hierarquia de transformações (guarda translação, rotação e escala separadas e só recalcula o que mudou)
+TransformHierarchy transforms;
+// Nó do cubo na hierarquia
+TransformNode cuboNode;
+
+// Partículas simuladas na GPU, lançadas quando o cubo bate numa parede (até 1 milhão ao mesmo tempo)
+ParticleSystem particulas(1 << 20, 2.0f);
+
+// Animação feita na GPU: cada cubo tem parâmetros fixos e o vertex shader calcula rotação e
+// posição (com rebatidas nas paredes) a partir do tempo
+GpuAnimation animacao;
+// Programa de shaders do modo de animação na GPU
+int programGPU;
+// VAO do cubo com os atributos por instância da animação
+unsigned int VAO_GPU;
+// Desenha (ou não) os cubos animados na GPU
+bool animacaoGPU = false;
+// Quantidade de cubos animados na GPU
+const int cubosGPU = 1000;
+
+// Programa de shaders do modo de geometria procedural (cubo gerado no vertex shader, sem VBO)
+int programProc;
+// Desenha o cubo com a geometria procedural
+bool geometriaProcedural = false;
+
+// Formatos do VBO do cubo, alternados com 'k': floats (36 bytes por vértice), posição em half float ou
+// em shorts normalizados com normal 10:10:10:2 e cor de 8 bits (16 bytes por vértice)
+const VertexPackFormat formatosCubo[] = {
+    { POSITION_FLOAT, false, false },
+    { POSITION_HALF, true, true },
+    { POSITION_SNORM16, true, true },
+};
+int formatoCubo = 2;
+// Vértices do cubo no formato atual (guarda a escala de dequantização enviada aos shaders)
+PackedVertices cuboEmpacotado;
+// Malha indexada do cubo, com triângulos e vértices reordenados na carga (cache de vértices, overdraw, busca)
+std::vector<VerticeCubo> verticesCubo;
+std::vector<unsigned int> indicesCubo;
+
+// Malha densa (esfera de 65 mil triângulos) desenhada no lugar do cubo com 'l', dividida em meshlets.
+// A cada frame os meshlets fora da tela ou totalmente de costas são descartados na CPU antes do envio
+bool malhaDensa = false;
+unsigned int VAO_DENSA, VBO_DENSA, EBO_DENSA;
+PackedVertices densaEmpacotada;
+MeshletCuller meshlets;
+// A malha densa é gerada, otimizada e enviada em segundo plano pelo carregador; enquanto não fica pronta,
+// 'l' continua mostrando o cubo no lugar dela. O worker preenche estas variáveis, lidas só depois de pronta
+MeshletSet meshletsDensa;
+PackedVertices posicoesDensa;
+// Declarado depois dos dados que os workers preenchem: é destruído (esperando as threads) antes deles
+AssetLoader carregador;
+int assetDensa = -1;
+bool densaPedida = false, densaPronta = false;
+
+// Malhas fechadas e com orientação consistente (verificadas na carga): só elas são desenhadas com
+// descarte de faces de trás (GL_CULL_FACE), que pula os triângulos de costas antes da rasterização
+bool cuboFechado = false;
+bool densaFechada = false;
+
+// Pré-passada de profundidade ('z'): a cena é desenhada antes só com as posições e sem cor, e depois
+// sombreada com GL_EQUAL, de modo que cada pixel passa pelo fragment shader de Phong uma única vez
+DepthPrepass prepass;
+// Programas da passada de profundidade (malha indexada, animação na GPU e cubo procedural)
+int programProfundidade, programGPUProfundidade, programProcProfundidade;
+// Fluxos só de posição (mesma codificação e escala dos VBOs completos) lidos pela passada de profundidade
+unsigned int VAO1_POS, VBO1_POS, VAO_GPU_POS, VAO_DENSA_POS, VBO_DENSA_POS;
+// Cena de várias malhas ('m'): cubos, esferas e toros em buffers de vértices e índices compartilhados,
+// desenhados com um único glMultiDrawElementsIndirect por passada. Cada objeto acha sua matriz model e
+// seu material pelo índice do desenho (drawID)
+// Buffers grandes de vértices e índices repartidos entre as malhas, com um VAO por formato de vértice
+// ('e' troca a esfera de resolução, deixando buracos nos buffers; 'h' desfragmenta e mostra a ocupação)
+GpuMeshHeap heap;
+void layoutVerticeCubo(void);
+MultiDraw cenaMalhas(heap, sizeof(VerticeCubo), offsetof(VerticeCubo, position), layoutVerticeCubo);
+int malhasCena[3];
+bool esferaDetalhada = false;
+bool cenaMultipla = false;
+// Objetos por eixo da grade da cena de várias malhas
+const int objetosEixo = 10;
+int programMDI, programMDIProfundidade;
 
-// Shader de vértices
-const char *vertex_code = "\n"
+// Tempo de cada fase da inicialização, do início do programa até o primeiro frame com a cena
+StartupProfiler perfilInicio;
+// Todos os programas são compilados juntos; enquanto o driver compila, display() só limpa a tela
+ShaderBatch shaders;
+bool shadersProntos = false;
+bool primeiroFrame = true;
+
+// Tempo do frame em segundos: as duas passadas da animação na GPU precisam da mesma posição
+float tempoFrame = 0.0f;
+
+
+// Shader de vértices (início; unpackPosition vem de VERTEXPACK_GLSL)
+const char *vertex_head = "\n"
                           "#version 330 core\n"
-                          "layout (location = 0) in vec3 position;\n"
-                          "layout (location = 1) in vec3 normal;\n"
+                          "layout (location = 0) in vec3 packedPosition;\n"
+                          "layout (location = 1) in vec3 color;\n"
+                          "layout (location = 2) in vec3 normal;\n"
+                          "layout (location = 3) in mat4 model;\n"
                           "\n"
-                          "uniform mat4 model;\n"
                           "uniform mat4 view;\n"
-                          "uniform mat4 projection;\n"
-                          "\n"
-                          "\n"
+                          "uniform mat4 projection;\n";
+
+// Shader de vértices (função principal). A posição chega quantizada e é reconstruída com a escala da malha
+const char *vertex_main = "\n"
+                          "invariant gl_Position;\n"
                           "out vec3 vNormal;\n"
                           "out vec3 fragPosition;\n"
                           "out vec3 vertexColor;\n"
                           "\n"
                           "void main()\n"
                           "{\n"
+                          "    vec3 position = unpackPosition(packedPosition);\n"
                           "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
-                          "    vNormal = mat3(transpose(inverse(model)))*normal;;\n"
+                          "    vNormal = mat3(transpose(inverse(model)))*normal;\n"
                           "    fragPosition = vec3(model * vec4(position, 1.0));\n"
-                          "    vertexColor = normal;\n"
+                          "    vertexColor = color;\n"
                           "}\0";
 
+// Shader de vértices da passada de profundidade: só a posição, calculada exatamente como em vertex_main
+const char *vertex_depth_main = "\n"
+                                "invariant gl_Position;\n"
+                                "\n"
+                                "void main()\n"
+                                "{\n"
+                                "    vec3 position = unpackPosition(packedPosition);\n"
+                                "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+                                "}\0";
+
+// Shader de vértices do modo de animação na GPU (início; animModel vem de GPUANIM_GLSL e unpackPosition de VERTEXPACK_GLSL)
+const char *vertex_gpu_head = "\n"
+                              "#version 330 core\n"
+                              "layout (location = 0) in vec3 packedPosition;\n"
+                              "layout (location = 1) in vec3 color;\n"
+                              "layout (location = 2) in vec3 normal;\n"
+                              "layout (location = 3) in vec4 motion;\n"
+                              "layout (location = 4) in vec4 spin;\n"
+                              "layout (location = 5) in vec4 phase;\n"
+                              "\n"
+                              "uniform mat4 view;\n"
+                              "uniform mat4 projection;\n";
+
+// Shader de vértices do modo de animação na GPU (função principal, mesmas saídas do shader do cubo)
+const char *vertex_gpu_main = "\n"
+                              "invariant gl_Position;\n"
+                              "out vec3 vNormal;\n"
+                              "out vec3 fragPosition;\n"
+                              "out vec3 vertexColor;\n"
+                              "\n"
+                              "void main()\n"
+                              "{\n"
+                              "    mat4 model = animModel(motion, spin, phase);\n"
+                              "    vec3 position = unpackPosition(packedPosition);\n"
+                              "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+                              "    vNormal = mat3(transpose(inverse(model)))*normal;\n"
+                              "    fragPosition = vec3(model * vec4(position, 1.0));\n"
+                              "    vertexColor = color;\n"
+                              "}\0";
+
+// Shader de vértices da passada de profundidade da animação na GPU (mesma posição de vertex_gpu_main)
+const char *vertex_gpu_depth_main = "\n"
+                                    "invariant gl_Position;\n"
+                                    "\n"
+                                    "void main()\n"
+                                    "{\n"
+                                    "    mat4 model = animModel(motion, spin, phase);\n"
+                                    "    vec3 position = unpackPosition(packedPosition);\n"
+                                    "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+                                    "}\0";
+
+// Shader de vértices do modo de geometria procedural (início; cubeVertex vem de PROCGEOM_GLSL).
+// Não há atributos por vértice: posição e normal saem de gl_VertexID; a model vem da fila, por instância
+const char *vertex_proc_head = "\n"
+                               "#version 330 core\n"
+                               "layout (location = 3) in mat4 model;\n"
+                               "\n"
+                               "uniform mat4 view;\n"
+                               "uniform mat4 projection;\n";
+
+// Shader de vértices do modo de geometria procedural (função principal).
+// Como não há cor por vértice, a cor é derivada da normal
+const char *vertex_proc_main = "\n"
+                               "invariant gl_Position;\n"
+                               "out vec3 vNormal;\n"
+                               "out vec3 fragPosition;\n"
+                               "out vec3 vertexColor;\n"
+                               "\n"
+                               "void main()\n"
+                               "{\n"
+                               "    vec3 position, normal;\n"
+                               "    cubeVertex(gl_VertexID, position, normal);\n"
+                               "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+                               "    vNormal = mat3(transpose(inverse(model)))*normal;\n"
+                               "    fragPosition = vec3(model * vec4(position, 1.0));\n"
+                               "    vertexColor = 0.5 + 0.5 * normal;\n"
+                               "}\0";
+
+// Shader de vértices da passada de profundidade do cubo procedural (mesma posição de vertex_proc_main)
+const char *vertex_proc_depth_main = "\n"
+                                     "invariant gl_Position;\n"
+                                     "\n"
+                                     "void main()\n"
+                                     "{\n"
+                                     "    vec3 position, normal;\n"
+                                     "    cubeVertex(gl_VertexID, position, normal);\n"
+                                     "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+                                     "}\0";
+
+// Shader de vértices da cena de várias malhas (início; drawModel e drawMaterial vêm de MULTIDRAW_GLSL)
+const char *vertex_mdi_head = "\n"
+                              "#version 330 core\n"
+                              "layout (location = 0) in vec3 position;\n"
+                              "layout (location = 1) in vec3 color;\n"
+                              "layout (location = 2) in vec3 normal;\n"
+                              "\n"
+                              "uniform mat4 view;\n"
+                              "uniform mat4 projection;\n";
+
+// Shader de vértices da cena de várias malhas (função principal). A cor do vértice é tingida pelo material
+const char *vertex_mdi_main = "\n"
+                              "invariant gl_Position;\n"
+                              "out vec3 vNormal;\n"
+                              "out vec3 fragPosition;\n"
+                              "out vec3 vertexColor;\n"
+                              "\n"
+                              "void main()\n"
+                              "{\n"
+                              "    mat4 model = drawModel();\n"
+                              "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+                              "    vNormal = mat3(transpose(inverse(model)))*normal;\n"
+                              "    fragPosition = vec3(model * vec4(position, 1.0));\n"
+                              "    vertexColor = color * drawMaterial().rgb;\n"
+                              "}\0";
+
+// Shader de vértices da passada de profundidade da cena de várias malhas (mesma posição de vertex_mdi_main)
+const char *vertex_mdi_depth_main = "\n"
+                                    "invariant gl_Position;\n"
+                                    "\n"
+                                    "void main()\n"
+                                    "{\n"
+                                    "    mat4 model = drawModel();\n"
+                                    "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+                                    "}\0";
+
 // Fragment shader: Calcula a cor final de cada pixel do cubo. Implementa o modelo de iluminação Phong (luz ambiente + luz difusa + luz especular)
 const char *fragment_code = "\n"
                             "#version 330 core\n"
@@ -113,23 +397,60 @@ const char *fragment_code = "\n"
                             "}\0";
 
 void display(void);
+bool verificaShaders(void);
 void reshape(int, int);
 void keyboard(unsigned char, int, int);
 void idle(void);
+void update(int);
+void tick(double);
+void atualizaTransformacao(void);
+void desenhaAnimacaoGPU(const glm::mat4 &, const glm::mat4 &, bool);
+void desenhaCena(bool, const glm::mat4 &, const glm::mat4 &, const glm::mat4 &, float, int);
+void preparaCenaMultipla(void);
+void trocaEsfera(void);
+void montaCenaMultipla(const glm::mat4 &);
+void enviaUniformsCena(int, const glm::mat4 &, const glm::mat4 &);
+bool verificaMalha(const char *, std::vector<unsigned int> &, const std::vector<VerticeCubo> &);
+void preparaMalhaCubo(void);
+void carregaCubo(void);
+void preparaMalhaDensa(Asset &);
+void ativaMalhaDensa(const Asset &);
+void verificaAssets(void);
+int cullMalhaDensa(const glm::mat4 &, const glm::vec4 &);
 void initData(void);
 void initShaders(void);
+void rotulaObjetos(void);
 
 // Função de renderização principal do programa
 void display()
 {
+    TRACE_SCOPE("display");
+
+    // Sem os programas prontos, mostra só a cor de fundo e volta ao laço de eventos
+    if (!verificaShaders())
+    {
+        cacheClearColor(bgColorR, bgColorG, bgColorB, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glutSwapBuffers();
+        cacheEndFrame();
+        schedulerFrameDone();
+        return;
+    }
+
+    // Recebe as malhas carregadas em segundo plano (sem esperar por elas)
+    verificaAssets();
+
+    // No modo adaptativo, desenha no alvo fora da tela na resolução escolhida pelo controlador
+    dynres.begin();
+
     // Define a cor para “apagar” a tela antes de desenhar
-    glClearColor(bgColorR, bgColorG, bgColorB, 1.0f);
+    cacheClearColor(bgColorR, bgColorG, bgColorB, 1.0f);
 
     // Apaga/pinta a tela com a cor definida. Usada antes de desenhar a cena
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Ativa o programa de shaders
-    glUseProgram(program);
+    cacheUseProgram(program);
 
     // Define a matriz de visualização (simula uma câmera olhando para a origem a partir da posição (0, 0, 3))
     glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
@@ -139,28 +460,18 @@ void display()
     glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(view));
 
     // Configura a matriz de projeção (define uma projeção em perspectiva com campo de visão de 52°)
-    glm::mat4 projection = glm::perspective(glm::radians(52.0f), (win_width / (float)win_height), 0.1f, 100.0f);
+    const float perto = 0.1f, longe = 100.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(52.0f), (win_width / (float)win_height), perto, longe);
     
     // Envia a matriz projection ao shader
     loc = glGetUniformLocation(program, "projection");
     glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(projection));
 
-    // Prepara o cubo para renderização (Ativa o VAO que contém os vértices do cubo)
-    glBindVertexArray(VAO1);
-
-    // Cria transformações: escala, rotação (em x, y e z), e translação com base na posição do cubo
-    glm::mat4 S = glm::scale(glm::mat4(1.0f), glm::vec3(objeto_size));
-    glm::mat4 Rx = glm::rotate(glm::mat4(1.0f), glm::radians(cx_angle), glm::vec3(3.0f, 0.0f, 0.0f));
-    glm::mat4 Ry = glm::rotate(glm::mat4(1.0f), glm::radians(cy_angle), glm::vec3(0.0f, 3.0f, 0.0f));
-    glm::mat4 Rz = glm::rotate(glm::mat4(1.0f), glm::radians(cz_angle), glm::vec3(0.0f, 0.0f, 3.0f));
-    glm::mat4 T = glm::translate(glm::mat4(1.0f), glm::vec3(pos, 0.0f));
-    
-    // Combina as transformações para formar a matriz model
-    glm::mat4 model = T * Ry * Rx * Rz * S;
-
-    // Envia a matriz model para o shader
-    loc = glGetUniformLocation(program, "model");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(model));
+    // Recalcula as matrizes de mundo apenas dos nós que mudaram (T * Ry * Rx * Rz * S para o cubo)
+    transforms.update();
+    const glm::mat4 &model = transforms.world(cuboNode);
+    // Profundidade do centro do objeto na câmera, normalizada entre os planos de corte (ordena a fila)
+    float profundidadeModelo = glm::clamp((-(view * model[3]).z - perto) / (longe - perto), 0.0f, 1.0f);
 
     // loc = glGetUniformLocation(program, "objectColor");
     // glUniform3f(loc, 1.0f, 0.0f, 0.0f); 
@@ -177,11 +488,276 @@ void display()
     loc = glGetUniformLocation(program, "cameraPosition");
     glUniform3f(loc, 0.0, 0.0, 0.0);
 
-    // Desenha o cubo (tipo da primitiva=GL_TRIANGLES, início na posição 0 do array, 36 vértices a serem desenhados)
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    // Escala de dequantização das posições do VBO desenhado (cubo ou malha densa)
+    loc = glGetUniformLocation(program, "dequant");
+    glUniform4fv(loc, 1, malhaDensa ? densaEmpacotada.dequant : cuboEmpacotado.dequant);
+
+    // Tempo usado pela animação na GPU, o mesmo nas duas passadas
+    tempoFrame = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
+
+    // Descarta os meshlets invisíveis e deixa só os triângulos restantes no EBO da malha densa
+    // (a câmera está em (0, 0, 3) no mundo; o teste é feito no espaço do objeto)
+    int indicesDensa = 0;
+    if (malhaDensa && !geometriaProcedural)
+    {
+        TRACE_SCOPE("meshlets");
+        glm::vec4 camera = glm::inverse(model) * glm::vec4(0.0f, 0.0f, 3.0f, 1.0f);
+        indicesDensa = cullMalhaDensa(projection * view * model, camera);
+    }
+
+    // Monta os comandos de desenho da cena de várias malhas (usados pelas duas passadas)
+    if (cenaMultipla)
+    {
+        TRACE_SCOPE("monta cena");
+        montaCenaMultipla(projection * view);
+    }
+
+    // Descarta as faces de trás se a malha desenhada é fechada (o cubo procedural é o mesmo cubo)
+    if ((malhaDensa && !geometriaProcedural) ? densaFechada : cuboFechado)
+        cacheEnable(GL_CULL_FACE);
+    else
+        cacheDisable(GL_CULL_FACE);
+
+    // Com a pré-passada, preenche antes o buffer de profundidade; o sombreamento conta os fragmentos
+    // que passaram pelo fragment shader
+    if (prepass.enabled())
+    {
+        TRACE_SCOPE("profundidade");
+        TRACE_GPU_SCOPE("profundidade");
+        DebugGroup grupo("profundidade");
+        prepass.beginDepth();
+        desenhaCena(true, view, projection, model, profundidadeModelo, indicesDensa);
+    }
+    {
+        TRACE_SCOPE("sombreamento");
+        TRACE_GPU_SCOPE("sombreamento");
+        DebugGroup grupo("sombreamento");
+        prepass.beginShading();
+        desenhaCena(false, view, projection, model, profundidadeModelo, indicesDensa);
+        prepass.endShading();
+    }
+
+    // Desenha as partículas das colisões
+    glm::mat4 viewProjection = projection * view;
+    {
+        TRACE_SCOPE("partículas");
+        TRACE_GPU_SCOPE("partículas");
+        DebugGroup grupo("partículas");
+        particulas.draw(glm::value_ptr(viewProjection), 3.0f);
+    }
+
+    // Amplia a imagem renderizada para o tamanho da janela
+    {
+        TRACE_SCOPE("ampliação");
+        TRACE_GPU_SCOPE("ampliação");
+        DebugGroup grupo("ampliação");
+        dynres.end();
+    }
+
+    // Inicia a leitura do frame para gravação (não bloqueia; o frame é escrito alguns frames depois)
+    capture.frame(win_width, win_height);
 
     // Troca os buffers (double buffering) para exibir o frame atual
-    glutSwapBuffers();
+    {
+        TRACE_SCOPE("swap");
+        glutSwapBuffers();
+    }
+    cacheEndFrame();
+    // Recolhe os tempos da GPU que já ficaram prontos (sem esperar)
+    TRACE_END_FRAME();
+    // Fecha a contagem de avisos de desempenho do driver deste frame
+    debugOutputEndFrame();
+    // Libera de uma vez os dados temporários do frame (listas ordenadas, matrizes e dados por objeto)
+    frameArenaEndFrame();
+
+    // O primeiro frame com a cena encerra a medição da inicialização (glFinish só desta vez, para
+    // contar também o trabalho da GPU)
+    if (primeiroFrame)
+    {
+        glFinish();
+        perfilInicio.mark("primeiro frame");
+        perfilInicio.report();
+        primeiroFrame = false;
+    }
+
+    // Fecha a contagem de alocações e chamadas GL do frame (no modo de teste, falha se passou do aquecimento
+    // e alocou)
+    frameAuditEndFrame();
+
+    // Avisa o escalonador que o frame foi desenhado
+    schedulerFrameDone();
+}
+
+// Consulta, sem bloquear, se os shaders terminaram de compilar; na primeira vez que terminam, confere
+// os erros e libera os objetos de shader
+bool verificaShaders()
+{
+    if (shadersProntos)
+        return true;
+    if (!shaders.poll())
+        return false;
+
+    shaders.finish();
+    shadersProntos = true;
+    perfilInicio.mark(shaders.parallel() ? "espera dos shaders" : "compilação e link");
+    return true;
+}
+
+// Envia a malha da cena para a fila e desenha junto com os cubos animados na GPU, com os programas de
+// sombreamento ou com os da passada de profundidade (que leem os fluxos só de posição).
+// depth é a profundidade do objeto na câmera em [0, 1] e indicesDensa é o número de índices da malha densa que
+// restaram do descarte de meshlets
+void desenhaCena(bool profundidade, const glm::mat4 &view, const glm::mat4 &projection, const glm::mat4 &model,
+                 float depth, int indicesDensa)
+{
+    // Envia o cubo para a fila (tipo da primitiva=GL_TRIANGLES, índices do EBO a partir do primeiro).
+    // A matriz model vai como atributo por instância; a profundidade ordena de frente para trás
+    if (geometriaProcedural)
+    {
+        // Mesmo cubo, mas sem VBO: VAO vazio e vértices gerados no shader
+        int prog = profundidade ? programProcProfundidade : programProc;
+        enviaUniformsCena(prog, view, projection);
+        queue.submit(prog, 0, proceduralVAO(), GL_TRIANGLES, 0,
+                     proceduralVertexCount(PROC_CUBE), glm::value_ptr(model), depth);
+    }
+    else
+    {
+        // O programa principal já recebeu os uniforms em display()
+        int prog = profundidade ? programProfundidade : program;
+        if (profundidade)
+        {
+            enviaUniformsCena(prog, view, projection);
+            glUniform4fv(glGetUniformLocation(prog, "dequant"), 1,
+                         malhaDensa ? densaEmpacotada.dequant : cuboEmpacotado.dequant);
+        }
+
+        if (malhaDensa)
+            queue.submitIndexed(prog, 0, profundidade ? VAO_DENSA_POS : VAO_DENSA, GL_TRIANGLES,
+                                GL_UNSIGNED_INT, 0, indicesDensa, glm::value_ptr(model), depth);
+        else
+            queue.submitIndexed(prog, 0, profundidade ? VAO1_POS : VAO1, GL_TRIANGLES, GL_UNSIGNED_INT, 0,
+                                indicesCubo.size(), glm::value_ptr(model), depth);
+    }
+
+    // Ordena e desenha todos os pacotes enviados no frame
+    queue.flush();
+
+    // Desenha os cubos animados na GPU
+    if (animacaoGPU)
+        desenhaAnimacaoGPU(view, projection, profundidade);
+
+    // Desenha todos os objetos da cena de várias malhas com uma só chamada
+    if (cenaMultipla)
+    {
+        int prog = profundidade ? programMDIProfundidade : programMDI;
+        enviaUniformsCena(prog, view, projection);
+        cenaMalhas.draw(prog);
+    }
+}
+
+// Atributos de VerticeCubo no VAO compartilhado do heap (posição, cor e normal em float)
+void layoutVerticeCubo()
+{
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VerticeCubo), (void *)offsetof(VerticeCubo, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VerticeCubo), (void *)offsetof(VerticeCubo, color));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VerticeCubo), (void *)offsetof(VerticeCubo, normal));
+    glEnableVertexAttribArray(2);
+}
+
+// Envia as malhas da cena de várias malhas aos buffers compartilhados do heap
+void preparaCenaMultipla()
+{
+    static const auto cubo = meshCube<VerticeCubo>();
+    static const auto esfera = meshSphere<VerticeCubo, 24, 12>();
+    static const auto toro = meshTorus<VerticeCubo, 32, 12>();
+    malhasCena[0] = cenaMalhas.addMesh(cubo.vertices.data(), cubo.vertices.size(), cubo.indices.data(),
+                                       cubo.indices.size());
+    malhasCena[1] = cenaMalhas.addMesh(esfera.vertices.data(), esfera.vertices.size(), esfera.indices.data(),
+                                       esfera.indices.size());
+    malhasCena[2] = cenaMalhas.addMesh(toro.vertices.data(), toro.vertices.size(), toro.indices.data(),
+                                       toro.indices.size());
+}
+
+// Troca a esfera da cena de várias malhas pela versão de outra resolução. A malha antiga é liberada antes
+// de a nova ser alocada: a menor cabe no espaço da maior, mas a maior não cabe no da menor e vai para o fim
+// dos buffers, deixando um buraco que a desfragmentação ('h') fecha
+void trocaEsfera()
+{
+    static const auto simples = meshSphere<VerticeCubo, 24, 12>();
+    static const auto detalhada = meshSphere<VerticeCubo, 48, 24>();
+    esferaDetalhada = !esferaDetalhada;
+    if (esferaDetalhada)
+        cenaMalhas.replaceMesh(malhasCena[1], detalhada.vertices.data(), detalhada.vertices.size(),
+                               detalhada.indices.data(), detalhada.indices.size());
+    else
+        cenaMalhas.replaceMesh(malhasCena[1], simples.vertices.data(), simples.vertices.size(),
+                               simples.indices.data(), simples.indices.size());
+    printf("esfera: %s\n", esferaDetalhada ? "48x24" : "24x12");
+}
+
+// Coloca os objetos da cena de várias malhas numa grade atrás do cubo, girando com o tempo, e monta os
+// comandos de desenho (os objetos fora da tela são descartados). As matrizes model de todos os objetos são
+// compostas de uma vez pela matbatch (SIMD), a partir de posição, ângulos e escala na arena do frame
+void montaCenaMultipla(const glm::mat4 &viewProjection)
+{
+    const int n = objetosEixo * objetosEixo * objetosEixo;
+    FrameVector<float> px(n), py(n), pz(n), ax(n), ay(n), az(n), escala(n, 0.4f);
+    for (int i = 0; i < n; i++)
+    {
+        int x = i % objetosEixo, y = (i / objetosEixo) % objetosEixo, z = i / (objetosEixo * objetosEixo);
+        px[i] = 0.6f * (x - 0.5f * (objetosEixo - 1));
+        py[i] = 0.6f * (y - 0.5f * (objetosEixo - 1));
+        pz[i] = -1.0f - z;
+        // Cada objeto gira com uma fase própria, mais rápido em y
+        float angulo = glm::degrees(tempoFrame + 0.1f * i);
+        ax[i] = 0.3f * angulo;
+        ay[i] = angulo;
+        az[i] = 0.5f * angulo;
+    }
+
+    FrameVector<float> modelos(16 * n);
+    MatBatchInput entrada = { px.data(), py.data(), pz.data(), ax.data(), ay.data(), az.data(), escala.data() };
+    MatBatchOutput saida = { modelos.data(), NULL, NULL };
+    matComposeBatch(n, entrada, glm::value_ptr(viewProjection), saida);
+
+    cenaMalhas.begin();
+    for (int i = 0; i < n; i++)
+    {
+        int x = i % objetosEixo, y = (i / objetosEixo) % objetosEixo, z = i / (objetosEixo * objetosEixo);
+        float material[4] = { 0.5f + 0.5f * (x % 2), 0.5f + 0.5f * (y % 2), 0.5f + 0.5f * (z % 2), 1.0f };
+        cenaMalhas.add(malhasCena[i % 3], &modelos[16 * i], material);
+    }
+    cenaMalhas.build(glm::value_ptr(viewProjection));
+}
+
+// Ativa um programa e envia as matrizes de câmera e os dados da luz (os mesmos do programa principal)
+void enviaUniformsCena(int prog, const glm::mat4 &view, const glm::mat4 &projection)
+{
+    cacheUseProgram(prog);
+
+    glUniformMatrix4fv(glGetUniformLocation(prog, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(prog, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform3f(glGetUniformLocation(prog, "lightColor"), 1.0, 1.0, 1.0);
+    glUniform3f(glGetUniformLocation(prog, "lightPosition"), 0.0, 0.0, 0.0);
+    glUniform3f(glGetUniformLocation(prog, "cameraPosition"), 0.0, 0.0, 0.0);
+    glUniform4fv(glGetUniformLocation(prog, "dequant"), 1, cuboEmpacotado.dequant);
+}
+
+// Desenha todos os cubos do modo de animação na GPU com uma única chamada.
+// Por frame, só o tempo e os limites das paredes são enviados, qualquer que seja o número de cubos
+void desenhaAnimacaoGPU(const glm::mat4 &view, const glm::mat4 &projection, bool profundidade)
+{
+    int prog = profundidade ? programGPUProfundidade : programGPU;
+    enviaUniformsCena(prog, view, projection);
+
+    // Tempo em segundos desde o início do programa e limites das paredes
+    glUniform1f(glGetUniformLocation(prog, "time"), tempoFrame);
+    glUniform2f(glGetUniformLocation(prog, "bounds"), hLimit, vLimit);
+
+    cacheBindVertexArray(profundidade ? VAO_GPU_POS : VAO_GPU);
+    glDrawElementsInstanced(GL_TRIANGLES, indicesCubo.size(), GL_UNSIGNED_INT, 0, animacao.count());
 }
 
 // Atualiza o viewport e limites de colisão com base no tamanho da janela
@@ -191,8 +767,9 @@ void reshape(int width, int height)
     win_width  = width;
     win_height = height;
 
-    // Define a área da janela onde a imagem será desenhada. Começa no canto inferior esquerdo (0, 0) e vai até (width, height)
-    glViewport(0, 0, width, height);
+    // Define a área da janela onde a imagem será desenhada. Começa no canto inferior esquerdo (0, 0) e vai até (width, height).
+    // No modo adaptativo, o novo tamanho também realimenta o controlador de resolução
+    dynres.reshape(width, height);
 
     // Determina até onde o cubo pode ir em X e Y antes de "bater na parede"
     // Recalcula limites de colisão
@@ -216,120 +793,373 @@ void keyboard(unsigned char key, int x, int y)
     switch (key)
     {
     case 27: // (Esc) Encerra o pragrama
+        capture.stop();
         exit(0);
     case 'q': // Encerra o programa
     case 'Q':
+        capture.stop();
         exit(0);
+    case 'o': // Liga/desliga o modo sob demanda (pausa a animação; só redesenha quando algo muda)
+        schedulerSetOnDemand(!schedulerOnDemand());
+        break;
     case 'a': // Aumenta o tamanho do cubo
         objeto_size = glm::min(2.0f, objeto_size + 0.05f);
         break;
     case 'd': // Diminui o tamanho do cubo
         objeto_size = glm::max(0.05f, objeto_size - 0.05f);
         break;
+    case 'c': // Inicia/para a gravação dos frames
+        if (capture.active())
+            capture.stop();
+        else
+            capture.start(capturePath, FrameCapture::formatFromPath(capturePath), 60);
+        break;
+    case 'r': // Liga/desliga a resolução dinâmica
+        dynres.setEnabled(!dynres.enabled());
+        break;
+    case 'R': // Alterna o filtro de ampliação (bilinear ou com nitidez)
+        nitidez = !nitidez;
+        dynres.setFilter(nitidez ? UPSCALE_SHARPEN : UPSCALE_BILINEAR);
+        break;
+    case 'v': // Confere as rotinas vetorizadas de composição de matrizes contra o glm
+        printf("matrizes (%s): erro máximo %g\n", matBatchKernelName(MATBATCH_AUTO), matBatchVerify(4096));
+        break;
+    case 'g': // Liga/desliga os cubos animados na GPU
+        animacaoGPU = !animacaoGPU;
+        break;
+    case 'p': // Alterna entre o cubo do VBO e o cubo gerado no vertex shader
+        geometriaProcedural = !geometriaProcedural;
+        break;
+    case 'l': // Alterna entre o cubo e a malha densa dividida em meshlets (o cubo fica até ela carregar)
+        densaPedida = !densaPedida;
+        malhaDensa = densaPedida && densaPronta;
+        if (densaPedida && !densaPronta)
+            printf("malha densa ainda carregando: mostrando o cubo\n");
+        break;
+    case 'm': // Liga/desliga a cena de várias malhas
+        cenaMultipla = !cenaMultipla;
+        break;
+    case 'e': // Troca a resolução da esfera da cena de várias malhas
+        trocaEsfera();
+        break;
+    case 'z': // Liga/desliga a pré-passada de profundidade
+        prepass.setEnabled(!prepass.enabled());
+        break;
+    case 'k': // Alterna o formato dos vértices do cubo (float, half float, shorts normalizados)
+        formatoCubo = (formatoCubo + 1) % 3;
+        carregaCubo();
+        printf("vértices do cubo: posição %s, %d bytes por vértice\n",
+               positionEncodingName(cuboEmpacotado.format.position), cuboEmpacotado.stride);
+        break;
+    case 'f': // Mostra as estatísticas da fila de desenho e do cache de estado do último frame
+    {
+        printf("fila: %u desenhos, %u lotes, %u trocas de estado evitadas\n",
+               queue.stats().draws, queue.stats().batches, queue.stats().stateChangesAvoided);
+        printf("estado GL: %u chamadas emitidas, %u evitadas\n",
+               cacheFrameStats().issued, cacheFrameStats().elided);
+        printf("resolução: %dx%d (escala %.2f, %.2f ms)\n",
+               dynres.renderWidth(), dynres.renderHeight(), dynres.scale(), dynres.frameTime());
+        if (malhaDensa)
+            printf("meshlets: %u de %u visíveis (%u de costas, %u fora da tela), %u triângulos enviados\n",
+                   meshlets.stats().visible, meshlets.stats().meshlets, meshlets.stats().backfacing,
+                   meshlets.stats().outside, meshlets.stats().triangles);
+        if (cenaMultipla)
+            printf("várias malhas: %u objetos, %u fora da tela, %u comandos em %u chamadas (%s)\n",
+                   cenaMalhas.stats().objects, cenaMalhas.stats().culled, cenaMalhas.stats().commands,
+                   cenaMalhas.stats().calls, multiDrawPathName(cenaMalhas.path()));
+        printf("fragmentos sombreados: %u (pré-passada de profundidade %s)\n", prepass.shadedFragments(),
+               prepass.enabled() ? "ligada" : "desligada");
+        AssetLoaderStats carga = carregador.stats();
+        printf("carregador: %u na fila, %u decodificando, %u enviando, %u prontos; %zu bytes enviados (%s), "
+               "%.3f ms no frame\n", carga.queued, carga.decoding, carga.uploading, carga.ready, carga.bytesUploaded,
+               carregador.sharedContext() ? "contexto compartilhado" : "envio por frame", carga.updateMs);
+        FrameArenaStats arena = frameArenaStats();
+        printf("arena do frame: %zu bytes (pico %zu de %zu), %u blocos, %u mallocs no último frame\n",
+               arena.used, arena.peak, arena.capacity, arena.blocks, arena.mallocs);
+        DebugOutputStats depuracao = debugOutputStats();
+        if (depuracao.active)
+            printf("depuração GL: %u mensagens (%u omitidas), %u erros, %u avisos de desempenho "
+                   "(%u no último frame, pico %u)\n", depuracao.messages, depuracao.suppressed, depuracao.errors,
+                   depuracao.performance, depuracao.framePerformance, depuracao.peakFramePerformance);
+        if (frameAuditEnabled())
+        {
+            FrameAuditStats contas = frameAuditLastFrame();
+            printf("último frame: %u alocações (%zu bytes), %u mallocs da arena, %u liberações, %u chamadas GL "
+                   "(%u não permitidas)\n", contas.allocations, contas.bytes, contas.arenaMallocs, contas.frees,
+                   contas.glCalls, contas.forbiddenCalls);
+            frameAuditPrintCalls(10);
+        }
+        break;
     }
+    case 't': // Grava o trace (chrome://tracing ou Perfetto) com os frames guardados até agora
+        TRACE_WRITE();
+        break;
+    case 'h': // Desfragmenta os buffers compartilhados e mostra sua ocupação
+    {
+        bool moveu = heap.defragment();
+        const char *nomes[2] = { "vértices", "índices" };
+        const GpuBufferArena *arenas[2] = { &heap.vertexArena(), &heap.indexArena() };
+        for (int i = 0; i < 2; i++)
+        {
+            GpuArenaStats s = arenas[i]->stats();
+            printf("heap de %s: %zu de %zu bytes (%.1f%%), %u alocações, %u blocos livres, fragmentação %.2f\n",
+                   nomes[i], s.used, s.capacity, 100.0f * s.occupancy, s.allocations, s.freeBlocks,
+                   s.fragmentation);
+        }
+        printf("desfragmentação: %s\n", moveu ? "dados movidos" : "nada a mover");
+        break;
+    }
+    }
+
+    // No modo sob demanda, uma tecla pode ter mudado a cena
+    atualizaTransformacao();
+    schedulerInvalidate();
 }
 
 // Função usada para animação
 void idle()
 {
+    TRACE_SCOPE("idle");
     // Incrementa o ângulo de rotação (em x, y e z). Se ultrapassar 360°, "reinicia" o valor de forma suave
     cx_angle = ((cx_angle + cx_inc) < 360.0f) ? cx_angle + cx_inc : 360.0 - cx_angle + cx_inc;
     cy_angle = ((cy_angle + cy_inc) < 360.0f) ? cy_angle + cy_inc : 360.0 - cy_angle + cy_inc;
     cz_angle = ((cz_angle + cz_inc) < 360.0f) ? cz_angle + cz_inc : 360.0 - cz_angle + cz_inc;
 
-    // Garante que a função display() seja chamada novamente para desenhar o cubo com os novos ângulos
-    glutPostRedisplay();
+}
+
+// Verifica a malha e corrige a orientação dos triângulos (remove degenerados e repetidos, inverte os
+// que estão com a ordem trocada). Retorna true se ela é fechada e pode ser desenhada com descarte de faces
+bool verificaMalha(const char *nome, std::vector<unsigned int> &indices, const std::vector<VerticeCubo> &vertices)
+{
+    const int stride = sizeof(VerticeCubo) / sizeof(float);
+    int count = indices.size();
+    MeshCheckReport r = repairMesh(indices.data(), count, vertices[0].position, stride, vertices.size(),
+                                   vertices[0].normal);
+    indices.resize(count);
+
+    if (r.removed || r.flipped)
+        printf("%s: %d triângulos removidos, %d invertidos\n", nome, r.removed, r.flipped);
+    if (r.boundaryEdges || r.nonManifoldEdges || r.inconsistentEdges || r.normalMismatches)
+        printf("%s: %d arestas de borda, %d não manifold, %d inconsistentes, %d normais opostas\n", nome,
+               r.boundaryEdges, r.nonManifoldEdges, r.inconsistentEdges, r.normalMismatches);
+    printf("%s: %s\n", nome, r.closed ? "fechada, descarte de faces de trás ativo" : "aberta, sem descarte de faces");
+    return r.closed;
 }
 
 // Prepara os dados necessários para renderizar o cubo
-void initData()
+// Gera a malha indexada do cubo e a otimiza para a GPU, mostrando a eficiência do cache de vértices
+void preparaMalhaCubo()
 {
-    // Define o array de vértices do cubo
-    float cube[] = {
-        // Face frontal. Primeiro triângulo
-            // coordenada       // cor
-            -0.5f, -0.5f,  0.5f,  1.0f, 0.0f, 0.0f, //1R
-             0.5f, -0.5f,  0.5f,  0.0f, 1.0f, 0.0f, //2G
-             0.5f,  0.5f,  0.5f,  0.0f, 0.0f, 1.0f, //3B
-            // Face frontal. Segundo triângulo
-            -0.5f, -0.5f,  0.5f,  1.0f, 0.0f, 0.0f, //1R
-             0.5f,  0.5f,  0.5f,  0.0f, 0.0f, 1.0f, //3B
-            -0.5f,  0.5f,  0.5f,  1.0f, 1.0f, 0.0f, //4Y
-            // Face direita. Primeiro triângulo
-             0.5f, -0.5f,  0.5f,  0.0f, 1.0f, 0.0f, //2G
-             0.5f, -0.5f, -0.5f,  1.0f, 1.0f, 0.0f, //5Y
-             0.5f,  0.5f, -0.5f,  1.0f, 0.0f, 0.0f, //6R
-            // Face direita. Segundo triângulo
-             0.5f, -0.5f,  0.5f,  0.0f, 1.0f, 0.0f, //2G
-             0.5f,  0.5f, -0.5f,  1.0f, 0.0f, 0.0f, //6R
-             0.5f,  0.5f,  0.5f,  0.0f, 0.0f, 1.0f, //3B
-            // Face traseira. Primeiro triângulo
-             0.5f, -0.5f, -0.5f,  1.0f, 1.0f, 0.0f, //5Y
-            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f, //8B
-            -0.5f,  0.5f, -0.5f,  0.0f, 1.0f, 0.0f, //7G
-            // Face traseira. Segundo triângulo
-             0.5f, -0.5f, -0.5f,  1.0f, 1.0f, 0.0f, //5Y
-            -0.5f,  0.5f, -0.5f,  0.0f, 1.0f, 0.0f, //7G
-             0.5f,  0.5f, -0.5f,  1.0f, 0.0f, 0.0f, //6R
-            // Face esquerda. Primeiro triângulo
-            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f, //8B
-            -0.5f, -0.5f,  0.5f,  1.0f, 0.0f, 0.0f, //1R
-            -0.5f,  0.5f,  0.5f,  1.0f, 1.0f, 0.0f, //4Y
-            // Face esquerda. Segundo triângulo
-            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f, //8B
-            -0.5f,  0.5f,  0.5f,  1.0f, 1.0f, 0.0f, //4Y
-            -0.5f,  0.5f, -0.5f,  0.0f, 1.0f, 0.0f, //7G
-            // Face superior. Primeiro triângulo
-            -0.5f,  0.5f,  0.5f,  1.0f, 1.0f, 0.0f, //4Y
-             0.5f,  0.5f,  0.5f,  0.0f, 0.0f, 1.0f, //3B
-             0.5f,  0.5f, -0.5f,  1.0f, 0.0f, 0.0f, //6R
-            // Face superior. Segundo triângulo
-            -0.5f,  0.5f, 0.5f,  1.0f, 1.0f, 0.0f, //4Y
-             0.5f,  0.5f, -0.5f,  1.0f, 0.0f, 0.0f, //6R
-            -0.5f,  0.5f, -0.5f,  0.0f, 1.0f, 0.0f, //7G
-            // Face inferior. Primeiro triângulo
-            -0.5f, -0.5f, 0.5f,  1.0f, 0.0f, 0.0f, //1R
-            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f, //8B
-             0.5f, -0.5f, 0.5f,  0.0f, 1.0f, 0.0f, //2G
-            // Face inferioir. Segundo triângulo
-            -0.5f, -0.5f, -0.5f,  0.0f, 0.0f, 1.0f, //8B
-             0.5f, -0.5f, -0.5f,  1.0f, 1.0f, 0.0f, //5Y
-             0.5f, -0.5f,  0.5f,  0.0f, 1.0f, 0.0f //2G
-        };
+    // Vértices e índices do cubo gerados em tempo de compilação (posição, cor e normal; 24 vértices, 36 índices)
+    static constexpr auto cube = meshCube<VerticeCubo>();
+    verticesCubo.assign(cube.vertices.begin(), cube.vertices.end());
+    indicesCubo.assign(cube.indices.begin(), cube.indices.end());
+    cuboFechado = verificaMalha("cubo", indicesCubo, verticesCubo);
+
+    MeshOptimizeStats otimizacao = optimizeMesh(indicesCubo.data(), indicesCubo.size(), verticesCubo.data(),
+                                                verticesCubo.size(), sizeof(VerticeCubo),
+                                                offsetof(VerticeCubo, position));
+    verticesCubo.resize(otimizacao.vertexCount);
+    printf("cubo: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%d vértices, %d triângulos)\n",
+           otimizacao.before.acmr, otimizacao.after.acmr, otimizacao.before.atvr, otimizacao.after.atvr,
+           otimizacao.vertexCount, (int)indicesCubo.size() / 3);
+}
+
+// Gera a malha densa, otimiza, divide em meshlets e empacota os vértices. Roda numa thread do carregador,
+// sem contexto OpenGL: os dois fluxos de vértices viram os buffers do asset
+void preparaMalhaDensa(Asset &asset)
+{
+    // Gerada aqui, com a tesselagem como argumento: a versão constexpr da meshgen seria avaliada pelo
+    // compilador e poria uns 2 MB de vértices no binário
+    std::vector<VerticeCubo> vertices;
+    std::vector<unsigned int> indices;
+    meshSphere(256, 128, vertices, indices);
+    densaFechada = verificaMalha("malha densa", indices, vertices);
+
+    MeshOptimizeStats otimizacao = optimizeMesh(indices.data(), indices.size(), vertices.data(), vertices.size(),
+                                                sizeof(VerticeCubo), offsetof(VerticeCubo, position));
+    vertices.resize(otimizacao.vertexCount);
+
+    const int stride = sizeof(VerticeCubo) / sizeof(float);
+    meshletsDensa = buildMeshlets(indices.data(), indices.size(), vertices[0].position, stride, vertices.size());
+    densaEmpacotada = packVertices(vertices.size(), stride, vertices[0].position, vertices[0].normal,
+                                   vertices[0].color, formatosCubo[2]);
+    // Fluxo só de posição da pré-passada de profundidade (8 bytes por vértice)
+    posicoesDensa = packVertices(vertices.size(), stride, vertices[0].position, NULL, NULL, formatosCubo[2]);
+
+    asset.data.resize(2);
+    asset.data[0].swap(densaEmpacotada.data);
+    asset.data[1].swap(posicoesDensa.data);
+}
+
+// Com os buffers da malha densa já na GPU, cria os VAOs (que não são compartilhados entre contextos) e o
+// EBO, preenchido a cada frame com os meshlets visíveis
+void ativaMalhaDensa(const Asset &asset)
+{
+    VBO_DENSA = asset.buffers[0];
+    VBO_DENSA_POS = asset.buffers[1];
+    meshlets.setMeshlets(meshletsDensa);
+
+    glGenVertexArrays(1, &VAO_DENSA);
+    glGenBuffers(1, &EBO_DENSA);
+    cacheBindVertexArray(VAO_DENSA);
+    cacheBindBuffer(GL_ARRAY_BUFFER, VBO_DENSA);
+    cacheBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_DENSA);
+    // Capacidade para todos os índices: o que sobra após o culling nunca passa disso.
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshletsDensa.indices.size() * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+    packedVertexAttributes(densaEmpacotada, 0, 2, 1);
+
+    glGenVertexArrays(1, &VAO_DENSA_POS);
+    cacheBindVertexArray(VAO_DENSA_POS);
+    cacheBindBuffer(GL_ARRAY_BUFFER, VBO_DENSA_POS);
+    cacheBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_DENSA);
+    packedVertexAttributes(posicoesDensa, 0, -1, -1);
+    cacheBindVertexArray(0);
 
+    debugLabel(GL_VERTEX_ARRAY, VAO_DENSA, "malha densa");
+    debugLabel(GL_VERTEX_ARRAY, VAO_DENSA_POS, "malha densa (posições)");
+    debugLabel(GL_BUFFER, VBO_DENSA, "malha densa: vértices");
+    debugLabel(GL_BUFFER, VBO_DENSA_POS, "malha densa: posições");
+    debugLabel(GL_BUFFER, EBO_DENSA, "malha densa: meshlets visíveis");
+}
+
+// Avança os envios do carregador e, quando a malha densa fica pronta, passa a desenhá-la se foi pedida
+void verificaAssets()
+{
+    carregador.update();
+    if (densaPronta)
+        return;
+
+    const Asset *asset = carregador.ready(assetDensa);
+    if (!asset)
+        return;
+
+    ativaMalhaDensa(*asset);
+    densaPronta = true;
+    malhaDensa = densaPedida;
+}
+
+// Descarta os meshlets da malha densa fora do frustum ou de costas para a câmera e envia os índices
+// restantes ao EBO. Retorna o número de índices a desenhar
+int cullMalhaDensa(const glm::mat4 &mvp, const glm::vec4 &camera)
+{
+    meshlets.cull(glm::value_ptr(mvp), glm::value_ptr(camera), MESHLET_COMPACT_INDICES);
+
+    const std::vector<unsigned int> &indices = meshlets.indices();
+    cacheBindVertexArray(VAO_DENSA);
+    cacheBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_DENSA);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+    return indices.size();
+}
+
+// Converte o cubo para o formato atual, envia ao VBO e aponta os atributos 0 (posição), 1 (cor) e 2 (normal)
+// e o EBO dos dois VAOs que o usam
+void carregaCubo()
+{
+    const int stride = sizeof(VerticeCubo) / sizeof(float);
+    cuboEmpacotado = packVertices(verticesCubo.size(), stride, verticesCubo[0].position, verticesCubo[0].normal,
+                                  verticesCubo[0].color, formatosCubo[formatoCubo]);
+
+    cacheBindBuffer(GL_ARRAY_BUFFER, VBO1);
+    glBufferData(GL_ARRAY_BUFFER, cuboEmpacotado.data.size(), cuboEmpacotado.data.data(), GL_STATIC_DRAW);
+    unsigned int vaos[] = { VAO1, VAO_GPU };
+    for (unsigned int vao : vaos)
+    {
+        cacheBindVertexArray(vao);
+        cacheBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO1);
+        packedVertexAttributes(cuboEmpacotado, 0, 2, 1);
+    }
+
+    // Fluxo só de posição da pré-passada de profundidade, com a mesma codificação (mesmos valores no shader)
+    PackedVertices posicoes = packVertices(verticesCubo.size(), stride, verticesCubo[0].position, NULL, NULL,
+                                           formatosCubo[formatoCubo]);
+    cacheBindBuffer(GL_ARRAY_BUFFER, VBO1_POS);
+    glBufferData(GL_ARRAY_BUFFER, posicoes.data.size(), posicoes.data.data(), GL_STATIC_DRAW);
+    unsigned int vaosPosicao[] = { VAO1_POS, VAO_GPU_POS };
+    for (unsigned int vao : vaosPosicao)
+    {
+        cacheBindVertexArray(vao);
+        cacheBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO1);
+        packedVertexAttributes(posicoes, 0, -1, -1);
+    }
+
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesCubo.size() * sizeof(unsigned int), indicesCubo.data(),
+                 GL_STATIC_DRAW);
+    cacheBindVertexArray(0);
+}
+
+void initData()
+{
     // VAO guarda os estados/configurações dos atributos de vértice. Definido como os dados serão lidos da GPU
     glGenVertexArrays(1, &VAO1);
-    glBindVertexArray(VAO1);
 
-    // Cria um buffer (VBO) e envia para a GPU os dados do cubo. GL_STATIC_DRAW indica que os dados não serão modificados.
+    // Cria os buffers de vértices (VBO) e de índices (EBO) do cubo (enviados por carregaCubo)
     glGenBuffers(1, &VBO1);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO1);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+    glGenBuffers(1, &EBO1);
 
-    // Define os atributos dos vértices
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float))); 
-    glEnableVertexAttribArray(2); 
+    // VAO do modo de animação na GPU: mesmo VBO do cubo mais os parâmetros de cada instância (locais 3, 4 e 5)
+    glGenVertexArrays(1, &VAO_GPU);
+    animacao.setInstances(GpuAnimation::random(cubosGPU, 1.5f, 1.0f, 0.8f));
+    animacao.setupVAO(VAO_GPU, 3);
+    cacheBindVertexArray(0);
 
-    // Finaliza a configuração do VAO
-    glBindVertexArray(0);
+    // VAOs só de posição da pré-passada de profundidade (o da animação também tem os atributos por instância)
+    glGenVertexArrays(1, &VAO1_POS);
+    glGenVertexArrays(1, &VAO_GPU_POS);
+    glGenBuffers(1, &VBO1_POS);
+    animacao.setupVAO(VAO_GPU_POS, 3);
+    cacheBindVertexArray(0);
+
+    // A malha densa é preparada em segundo plano, junto com o resto da carga
+    carregador.start();
+    assetDensa = carregador.load(preparaMalhaDensa);
+
+    // Otimiza a malha do cubo, envia os vértices no formato escolhido e define os atributos dos dois VAOs
+    preparaMalhaCubo();
+    carregaCubo();
+    preparaCenaMultipla();
 
     // Permite que o OpenGL desenhe corretamente objetos 3D baseados na profundidade
-    glEnable(GL_DEPTH_TEST);
+    cacheEnable(GL_DEPTH_TEST);
 }
 
-// Função para compilar, linkar e ativar os shaders usados na renderização do cubo 3D com OpenGL
+// Envia todos os shaders da renderização do cubo 3D para compilar e linkar juntos (sem esperar o
+// resultado, consultado por verificaShaders)
 void initShaders()
 {
-    program = createShaderProgram(vertex_code, fragment_code);
+    std::string vertex = std::string(vertex_head) + VERTEXPACK_GLSL + vertex_main;
+    program = shaders.add(vertex.c_str(), fragment_code);
+
+    // Junta o shader do modo de animação na GPU com a função de animação da biblioteca
+    std::string vertex_gpu = std::string(vertex_gpu_head) + GPUANIM_GLSL + VERTEXPACK_GLSL + vertex_gpu_main;
+    programGPU = shaders.add(vertex_gpu.c_str(), fragment_code);
+
+    // Shader do cubo procedural (sem buffer de vértices)
+    std::string vertex_proc = std::string(vertex_proc_head) + PROCGEOM_GLSL + vertex_proc_main;
+    programProc = shaders.add(vertex_proc.c_str(), fragment_code);
+
+    // Programas da pré-passada de profundidade: mesmas entradas e mesma conta da posição, sem cor
+    std::string vertex_depth = std::string(vertex_head) + VERTEXPACK_GLSL + vertex_depth_main;
+    programProfundidade = shaders.add(vertex_depth.c_str(), DEPTHPREPASS_FRAGMENT_GLSL);
+    std::string vertex_gpu_depth = std::string(vertex_gpu_head) + GPUANIM_GLSL + VERTEXPACK_GLSL + vertex_gpu_depth_main;
+    programGPUProfundidade = shaders.add(vertex_gpu_depth.c_str(), DEPTHPREPASS_FRAGMENT_GLSL);
+    std::string vertex_proc_depth = std::string(vertex_proc_head) + PROCGEOM_GLSL + vertex_proc_depth_main;
+    programProcProfundidade = shaders.add(vertex_proc_depth.c_str(), DEPTHPREPASS_FRAGMENT_GLSL);
+
+    // Programas da cena de várias malhas (matriz model e material lidos pelo índice do desenho)
+    std::string vertex_mdi = std::string(vertex_mdi_head) + MULTIDRAW_GLSL + vertex_mdi_main;
+    programMDI = shaders.add(vertex_mdi.c_str(), fragment_code);
+    std::string vertex_mdi_depth = std::string(vertex_mdi_head) + MULTIDRAW_GLSL + vertex_mdi_depth_main;
+    programMDIProfundidade = shaders.add(vertex_mdi_depth.c_str(), DEPTHPREPASS_FRAGMENT_GLSL);
+
+    // Os links só começam depois de todas as compilações terem sido enviadas
+    shaders.link();
 }
 
 // Move o cubo, detecta colisões, inverte direção, altera cor de fundo e tamanho do cubo
 void update(int value)
 {
+    TRACE_SCOPE("update");
     // Atualiza posição do cubo
     pos += vel;
     bool colisaoOcorreu = false;
@@ -350,6 +1180,10 @@ void update(int value)
         colisaoOcorreu = true;
     }
 
+    // Lança partículas a partir do cubo
+    if (colisaoOcorreu)
+        particulas.burst(pos.x, pos.y, 0.0f, 100000, 2.0f);
+
     // Altera tamanho
     if (colisaoOcorreu) {
         if (aumentarEscala) {
@@ -368,32 +1202,101 @@ void update(int value)
         objeto_size = glm::clamp(objeto_size, 0.05f, 2.0f);
     }
 
-    // Solicita redesenho da cena
-    glutPostRedisplay();
-    glutTimerFunc(16, update, 0); // ~60fps
+}
+
+// Chamada pelo escalonador uma vez por frame (~60fps), antes de redesenhar a cena
+void tick(double dt)
+{
+    TRACE_SCOPE("tick");
+    idle();
+    update(0);
+    atualizaTransformacao();
+
+    // Simula as partículas na GPU (nada é lido de volta para a CPU)
+    TRACE_SCOPE("simulação das partículas");
+    TRACE_GPU_SCOPE("simulação das partículas");
+    DebugGroup grupo("simulação das partículas");
+    particulas.update((float)dt);
+}
+
+// Copia posição, ângulos e tamanho do cubo para o seu nó na hierarquia (marcando-o como alterado)
+void atualizaTransformacao()
+{
+    transforms.setTranslation(cuboNode, glm::vec3(pos, 0.0f));
+    transforms.setEulerDegrees(cuboNode, glm::vec3(cx_angle, cy_angle, cz_angle));
+    transforms.setScale(cuboNode, glm::vec3(objeto_size));
+}
+
+// Dá nomes aos programas, VAOs e buffers nas mensagens do driver e nos depuradores de GPU
+void rotulaObjetos()
+{
+    debugLabel(GL_PROGRAM, program, "cubo");
+    debugLabel(GL_PROGRAM, programGPU, "animação na GPU");
+    debugLabel(GL_PROGRAM, programProc, "geometria procedural");
+    debugLabel(GL_PROGRAM, programProfundidade, "cubo (profundidade)");
+    debugLabel(GL_PROGRAM, programGPUProfundidade, "animação na GPU (profundidade)");
+    debugLabel(GL_PROGRAM, programProcProfundidade, "geometria procedural (profundidade)");
+    debugLabel(GL_PROGRAM, programMDI, "várias malhas");
+    debugLabel(GL_PROGRAM, programMDIProfundidade, "várias malhas (profundidade)");
+
+    debugLabel(GL_VERTEX_ARRAY, VAO1, "cubo");
+    debugLabel(GL_VERTEX_ARRAY, VAO_GPU, "animação na GPU");
+    debugLabel(GL_VERTEX_ARRAY, VAO1_POS, "cubo (posições)");
+    debugLabel(GL_VERTEX_ARRAY, VAO_GPU_POS, "animação na GPU (posições)");
+    debugLabel(GL_BUFFER, VBO1, "cubo: vértices");
+    debugLabel(GL_BUFFER, VBO1_POS, "cubo: posições");
+    debugLabel(GL_BUFFER, EBO1, "cubo: índices");
 }
 
 int main(int argc, char **argv)
 {
+    // O contexto de envio do carregador usa a conexão com o sistema de janelas em outra thread
+    AssetLoader::initThreads();
+    // Trace da linha do tempo de CPU e GPU, gravado com 't' e ao sair
+    TRACE_THREAD_NAME("render");
+    TRACE_INIT("cubo_trace.json");
     // Inicia a biblioteca GLUT
     glutInit(&argc, argv);
+    // Argumento opcional: saída da gravação (.ppm/.png com %d para o número do frame, ou .y4m)
+    if (argc > 1)
+        capturePath = argv[1];
     // Informa que o contexto é compatível com a versão OpenGL 3.3
     glutInitContextVersion(3, 3);
     // Informa a compatibilidade do contexto
     glutInitContextProfile(GLUT_CORE_PROFILE);
+    // Contexto de depuração (KHR_debug) só quando pedido pelo ambiente: a saída síncrona custa desempenho
+    if (debugOutputRequested())
+        glutInitContextFlags(GLUT_DEBUG);
     // Define opções de como uma cena deve ser renderizada
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
     // Define a dimensão da janela que será mostrada
     glutInitWindowSize(win_width, win_height);
     // Cria e define o nome da janela
     glutCreateWindow("Trabalho Cubo");
+    perfilInicio.mark("contexto");
     glewExperimental = GL_TRUE;
     // Inicia a compatibilidade de funções do OpenGL em diferentes sistemas operacionais
     glewInit();
+    if (debugOutputRequested())
+        debugOutputInit();
+    // Conta alocações e chamadas GL por frame (só no executável de "make audit")
+    frameAuditInit();
+    perfilInicio.mark("GLEW");
+
+    // Os shaders vão primeiro: o driver os compila enquanto as malhas são preparadas e enviadas
+    initShaders();
+    perfilInicio.mark("envio dos shaders");
 
     initData();
+    rotulaObjetos();
+    perfilInicio.mark("malhas e buffers");
 
-    initShaders();
+    // Cria o nó do cubo na hierarquia de transformações
+    cuboNode = transforms.create();
+    atualizaTransformacao();
+
+    // Cria os buffers e shaders das partículas
+    particulas.init();
 
     // Define a função para redimensionamento da janela
     glutReshapeFunc(reshape);
@@ -402,9 +1305,11 @@ int main(int argc, char **argv)
     // Define a função para tratar entradas do teclado
     glutKeyboardFunc(keyboard);
 
-    glutIdleFunc(idle);
-
-    glutTimerFunc(0, update, 0);
+    // Redesenha a ~60fps dormindo entre os frames (em vez de ocupar um núcleo com glutIdleFunc);
+    // a cada frame, tick() anima o cubo
+    schedulerInit(60.0, false);
+    schedulerSetTick(tick);
+    perfilInicio.mark("partículas e callbacks");
     // Loop que executa e gerencia as funções/callbacks que devem ser chamadas para cada evento que ocorre no programa
     glutMainLoop();
 }
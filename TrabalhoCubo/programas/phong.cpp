@@ -14,6 +14,9 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include "../lib/utils.h"
+#include "../lib/meshgen.h"
+#include "../lib/scenecache.h"
+#include "../lib/scheduler.h"
 
 
 /* Globals */
@@ -28,6 +31,8 @@ int program;
 unsigned int VAO;
 /** Vertex buffer object. */
 unsigned int VBO;
+/** Cached image of the (static) scene. */
+SceneCache sceneCache;
 
 
 /** Vertex shader. */
@@ -101,11 +106,22 @@ void initShaders(void);
  */
 void display()
 {
-    	glClearColor(1.0, 1.0, 1.0, 1.0);
+    	// Nothing changed since the last redisplay: show the cached image.
+    	if (sceneCache.present(win_width, win_height))
+    	{
+    		glutSwapBuffers();
+    		cacheEndFrame();
+    		schedulerFrameDone();
+    		return;
+    	}
+
+    	sceneCache.begin();
+
+    	cacheClearColor(1.0, 1.0, 1.0, 1.0);
     	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    	glUseProgram(program);
-    	glBindVertexArray(VAO);
+    	cacheUseProgram(program);
+    	cacheBindVertexArray(VAO);
 
 	glm::mat4 Rx = glm::rotate(glm::mat4(1.0f), glm::radians(10.0f), glm::vec3(1.0f,0.0f,0.0f));
 	glm::mat4 Ry = glm::rotate(glm::mat4(1.0f), glm::radians(-30.0f), glm::vec3(0.0f,1.0f,0.0f));
@@ -139,7 +155,11 @@ void display()
 
     	glDrawArrays(GL_TRIANGLES, 0, 36);
 
+    	sceneCache.end();
+
     	glutSwapBuffers();
+    	cacheEndFrame();
+    	schedulerFrameDone();
 }
 
 /**
@@ -155,7 +175,7 @@ void reshape(int width, int height)
     win_width = width;
     win_height = height;
     glViewport(0, 0, width, height);
-    glutPostRedisplay();
+    schedulerInvalidate();
 }
 
 
@@ -178,8 +198,6 @@ void keyboard(unsigned char key, int x, int y)
                 case 'Q':
                         glutLeaveMainLoop();
         }
-    
-	glutPostRedisplay();
 }
 
 
@@ -190,46 +208,8 @@ void keyboard(unsigned char key, int x, int y)
  */
 void initData()
 {
-    // Set cube vertices.
-    float vertices[] = {
-        // coordinate      // normal
-	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f, 
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f
-    };
+    // Set cube vertices (generated at compile time, baked into the binary).
+    static constexpr auto vertices = meshExpand(meshCube<VertexPN>());
     
     // Vertex array.
     glGenVertexArrays(1, &VAO);
@@ -238,7 +218,7 @@ void initData()
     // Vertex buffer
     glGenBuffers(1, &VBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices.data(), GL_STATIC_DRAW);
     
     // Set attributes.
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (void*)0);
@@ -248,8 +228,14 @@ void initData()
 
     // Unbind Vertex Array Object.
     glBindVertexArray(0);
+
+    // New geometry: the cached image is stale.
+    sceneCache.invalidate();
     
     glEnable(GL_DEPTH_TEST);
+
+    // The generated cube is closed and counter-clockwise: skip its back faces.
+    glEnable(GL_CULL_FACE);
 }
 
 /** Create program (shaders).
@@ -282,5 +268,8 @@ int main(int argc, char** argv)
     	glutDisplayFunc(display);
     	glutKeyboardFunc(keyboard);
 
+    	// The scene is static: draw only when something changes.
+    	schedulerInit(60.0, true);
+
 	glutMainLoop();
 }